@@ -19,6 +19,12 @@
 
 #include<getopt.h>
 
+/*
+ * String compare for the trace name stored in a checkpoint
+ */
+
+#include<string.h>
+
 /*
  * printf wrapper for debugging output
  */
@@ -40,6 +46,14 @@ unsigned long long blockBits ; //number of block bits (-b 5)
 short int numLines ; //number of Lines (-E 2)
 char * traceFile; //filename (-t trace/file1)
 int helpFlag = 0; //help enabled
+char * ckptFile = NULL; //checkpoint written to (-w ckpt/file1)
+char * resumeFile = NULL; //checkpoint resumed from (-r ckpt/file1)
+unsigned long long ckptInterval = 0; //checkpoint every N accesses (-p 100000)
+unsigned long long stopAfter = 0; //stop after N accesses (-n 100000)
+unsigned long long splitMask = 0; //all ones when accesses are split across lines (-x)
+unsigned long long intervalLen = 0; //interval stats every N accesses (-i 10000)
+char * intervalFile = NULL; //interval stats written to (-o stats/file1)
+int intervalBinary = 0; //interval stats as binary records (-B)
 
 /*
  * Parsing command line arguments
@@ -148,7 +162,54 @@ Line * findInvalidLine(Line ** );
 
 Line * evictLRLine(Line **);
 
+/*
+ * Magic string at the start of every checkpoint file
+ */
+
+#define CKPT_MAGIC "CSIMCKP2"
+
+/*
+ * saveCheckpoint : Writing full cache state to the checkpoint file
+ * Geometry (s, E, b, x), counters, timestamp, trace name and trace offset
+ * are written first, followed by index & lines of every allocated set.
+ * State goes to "<file>.tmp" which is renamed over <file>, so a killed
+ * job always leaves the last complete checkpoint behind
+ * Input : Array of Sets, checkpoint filename, trace offset
+ * Output : None
+ */
+
+void saveCheckpoint(Set * , char * , long );
+
+/*
+ * loadCheckpoint : Restoring cache state from the checkpoint file
+ * Geometry must match the current -s, -E, -b & -x options
+ * Input : Array of Sets, checkpoint filename
+ * Output : Trace offset to resume from (0 if the checkpoint was taken
+ *          on a different trace file)
+ */
+
+long loadCheckpoint(Set * , char * );
+
+/*
+ * writeInterval : Writing hits, misses & evicts of the interval ending at 
+ * the current access (difference from the previous interval) as a CSV 
+ * line or as a binary record of four unsigned long longs 
+ * (accesses, hits, misses, evicts)
+ * Input : Interval stats file
+ * Output : None
+ */
+
+void writeInterval(FILE * );
+
+/*
+ * readTraceLine : Reading the next data access (L, S or M) from the trace,
+ * instruction loads ('I') are skipped. Kept static here since csim.c is
+ * handed in alone and built against the stock cachelab.c
+ * Input : Trace file, pointers to access type, address & size
+ * Output : 1 if an access was read, 0 at end of file
+ */
 
+static int readTraceLine(FILE * , char * , Long * , unsigned int * );
 
 /*
  * Global timestamp counter
@@ -156,6 +217,15 @@ Line * evictLRLine(Line **);
 
 int timestamp=0 ;
 
+/*
+ * Global counters : numOfHits, numOfMisses & numOfEvicts (kept global
+ * so that they are saved and restored along with the cache state)
+ * numOfAccesses - number of accesses read from trace (excluding 'I')
+ */
+
+unsigned int numOfHits=0,numOfEvicts=0,numOfMisses=0;
+unsigned long long numOfAccesses = 0;
+
 int main(int argc,char ** argv) 
 { 
         parseOptions(argc,argv);
@@ -177,9 +247,7 @@ int main(int argc,char ** argv)
  * Size - Size of token read
  * Tag - Tag value from address
  * Set - Set value from address
- * numOfHits - counter to track number of hits
- * numOfEvicts - counter to track number of Evicts
- * numOfMisses - counter to track number of Misses
+ * firstBlock, lastBlock - block numbers of first & last byte accessed
  * E.g : OpType = 'L', Address = 0x20, Size = 4
  *       Tag,Set = (calculated using functions)
  */
@@ -189,7 +257,7 @@ int main(int argc,char ** argv)
         unsigned long long Address;
         unsigned int size;
         Long Tag, Set;
-        unsigned int numOfHits=0,numOfEvicts=0,numOfMisses=0;
+        Long firstBlock, lastBlock, block;
 /*
  * Opening the file and reading it line by line 
  */
@@ -201,35 +269,79 @@ int main(int argc,char ** argv)
                 fprintf(fp,"Unable to open the file\n");
                 exit(-1);
         }
-        char ch; //Garbage value to contain '\n' at the end of line
-        int count;//count for fscanf to check if the characters read are > 1
-        while (!feof(fp)) { 
-                if ((fgetc(fp)) != 'I') 
-                {  
-                      /*
-                       * Parsing line by line
-                       */
 
-                        count = fscanf(fp," %c %llx,%u%c",&OpType,&Address,&size
-                                        ,&ch);
+/*
+ * Restoring the cache state and seeking to the saved trace offset
+ */
 
-                        if ( count < 1 )
-                               break;
+        if (resumeFile != NULL) 
+        { 
+                long offset = loadCheckpoint(Sets,resumeFile);
+                if (fseek(fp,offset,SEEK_SET) != 0) 
+                { 
+                        printf("Unable to seek to offset %ld in %s\n",offset,
+                                        traceFile);
+                        exit(-1);
+                }
+        }
+/*
+ * Opening the interval stats file, nextInterval is the access count at
+ * which the next interval ends
+ */
 
-                       /*
-                        * Getting Tag value & SetValue from Address
-                        */
+        FILE * ifp = NULL;
+        unsigned long long nextInterval = 0;
+        if (intervalLen) 
+        { 
+                ifp = fopen(intervalFile,intervalBinary ? "wb" : "w");
+                if (ifp == NULL) 
+                { 
+                        printf("Unable to open interval file %s\n",
+                                        intervalFile);
+                        exit(-1);
+                }
+                if (!intervalBinary) 
+                { 
+                        fprintf(ifp,"accesses,hits,misses,evictions,"
+                                        "miss_rate\n");
+                }
+                writeInterval(NULL);
+                nextInterval = numOfAccesses + intervalLen;
+        }
+
+        /*
+         * Parsing line by line, instruction loads ('I') are skipped by
+         * readTraceLine
+         */
+
+        while (readTraceLine(fp,&OpType,&Address,&size)) { 
+               /*
+                * Blocks touched by the access : splitMask is zero 
+                * by default (one block per access, like csim-ref)
+                * and all ones with -x, so the last byte is taken 
+                * into account without a branch on the option
+                */
 
-                        Tag = tagValue(Address);
-                        Set = setValue(Address);
+                firstBlock = Address >> blockBits;
+                lastBlock = (Address + ((size - (size != 0)) & 
+                                        splitMask)) >> blockBits;
 
-                        int anotherIteration  = 0;
+                int anotherIteration  = 0;
 
-                        if (OpType == 'M') 
+                if (OpType == 'M') 
+                { 
+                        anotherIteration = 1;
+                }
+                do { 
+                        for (block = firstBlock; block <= lastBlock; block++)
                         { 
-                                anotherIteration = 1;
-                        }
-                        do { 
+                                /*
+                                 * Getting Tag value & SetValue from Address
+                                 */
+
+                                Tag = tagValue(block << blockBits);
+                                Set = setValue(block << blockBits);
+
                                 if (isHit(Sets,Tag,Set)) 
                                 {
                                         numOfHits++;
@@ -243,19 +355,50 @@ int main(int argc,char ** argv)
                                                 numOfEvicts++;
                                         } 
                                 }
-                        } while ((OpType == 'M') && anotherIteration--); 
+                        }
+                } while ((OpType == 'M') && anotherIteration--); 
+
+               /*
+                * Periodic checkpoint & prefix limit, taken at the 
+                * start of the next trace line
+                */
+
+                numOfAccesses++;
+                if (numOfAccesses == nextInterval) 
+                { 
+                        writeInterval(ifp);
+                        nextInterval += intervalLen;
                 }
-                else 
-                {
-                        /*
-                         * Skipping the line that starts with 'I'
-                         */
-
-                        count = fscanf(fp," %c %llx,%u%c",&OpType,&Address,&size
-                                        ,&ch);
+                if (ckptInterval && !(numOfAccesses % ckptInterval)) 
+                { 
+                        saveCheckpoint(Sets,ckptFile,ftell(fp));
+                }
+                if (numOfAccesses == stopAfter) 
+                { 
+                        break;
                 }
         }
 
+/*
+ * Last (partial) interval
+ */
+        if (ifp != NULL) 
+        { 
+                if (numOfAccesses + intervalLen != nextInterval) 
+                { 
+                        writeInterval(ifp);
+                }
+                fclose(ifp);
+        }
+
+/*
+ * Final checkpoint (warmed cache after -n accesses or the full trace)
+ */
+        if (ckptFile != NULL) 
+        { 
+                saveCheckpoint(Sets,ckptFile,ftell(fp));
+        }
+
 /*
  * Free the sets memory
  * Make all the lines free 
@@ -288,13 +431,21 @@ int main(int argc,char ** argv)
  * blockBits = 4
  * numberLines = 1
  * filename = "trace/file1"
+ * Checkpoint options : "-w ckpt -p 100000 -n 500000" saves the cache state
+ * to ckpt every 100000 accesses and stops after 500000 accesses,
+ * "-r ckpt" resumes from the saved state
+ * "-x" splits every access into all the blocks it touches, so an access 
+ * straddling a block boundary (or a 32/64 byte vector access) counts
+ * once per block
+ * "-i 10000 -o stats.csv" writes hits/misses/evicts of every 10000 
+ * accesses to stats.csv ("-B" for binary records)
  */
 
 void parseOptions(int argc, char ** argv) 
 { 
         int opt;
         int sflag=0,Eflag=0,bflag=0,tflag=0;
-        while (-1 != (opt = getopt(argc, argv, "s:E:b:t:vh")))
+        while (-1 != (opt = getopt(argc, argv, "s:E:b:t:w:r:p:n:xi:o:Bvh")))
         { 
                 switch(opt) 
                 { 
@@ -314,6 +465,30 @@ void parseOptions(int argc, char ** argv)
                                 tflag = 1;
                                 traceFile = optarg;
                                 break;
+                        case 'w' : 
+                                ckptFile = optarg;
+                                break;
+                        case 'r' : 
+                                resumeFile = optarg;
+                                break;
+                        case 'p' : 
+                                ckptInterval = strtoull(optarg,NULL,10);
+                                break;
+                        case 'n' : 
+                                stopAfter = strtoull(optarg,NULL,10);
+                                break;
+                        case 'x' : 
+                                splitMask = ~0ULL;
+                                break;
+                        case 'i' : 
+                                intervalLen = strtoull(optarg,NULL,10);
+                                break;
+                        case 'o' : 
+                                intervalFile = optarg;
+                                break;
+                        case 'B' : 
+                                intervalBinary = 1;
+                                break;
                         case 'v' : 
                                 PRINTF("Verbose enabled\n");
                                 break;
@@ -331,6 +506,16 @@ void parseOptions(int argc, char ** argv)
                                         \n"); 
                 }
         }
+        if (ckptInterval && (ckptFile == NULL)) 
+        { 
+                printf("Checkpoint interval (-p) needs a checkpoint file (-w)\n");
+                exit(-1);
+        }
+        if (intervalLen && (intervalFile == NULL)) 
+        { 
+                printf("Stats interval (-i) needs an output file (-o)\n");
+                exit(-1);
+        }
 }
 
 
@@ -468,3 +653,209 @@ Line * evictLRLine(Line ** line)
         
         return lineArr;
 }
+
+/*
+ * saveCheckpoint : Writing full cache state to the checkpoint file
+ * Layout : magic, s, E, b, timestamp, hits, misses, evicts, accesses,
+ * trace offset, trace name length & name, number of allocated sets and
+ * then for every allocated set its index followed by E lines
+ * (valid, tag, count)
+ * Input : Array of Sets, checkpoint filename, trace offset
+ * Output : None
+ */
+
+void saveCheckpoint(Set * Sets, char * fileName, long offset) 
+{ 
+        char tmpName[FILENAME_MAX];
+        unsigned int numberOfSets = 1 << setBits;
+        unsigned int usedSets = 0;
+        unsigned int nameLen = strlen(traceFile);
+        int  shortLines = numLines;
+        long long hdr[9] = {setBits, blockBits, timestamp, numOfHits,
+                numOfMisses, numOfEvicts, numOfAccesses, offset, 
+                splitMask != 0};
+
+        snprintf(tmpName,sizeof(tmpName),"%s.tmp",fileName);
+        FILE * fp = fopen(tmpName,"wb");
+        if (fp == NULL) 
+        { 
+                printf("Unable to open checkpoint file %s\n",tmpName);
+                exit(-1);
+        }
+        for (unsigned int i = 0 ; i < numberOfSets; i++) 
+        { 
+                if (Sets[i] != NULL) 
+                { 
+                        usedSets++;
+                }
+        }
+        fwrite(CKPT_MAGIC,1,sizeof(CKPT_MAGIC) - 1,fp);
+        fwrite(&shortLines,sizeof(shortLines),1,fp);
+        fwrite(hdr,sizeof(hdr[0]),9,fp);
+        fwrite(&nameLen,sizeof(nameLen),1,fp);
+        fwrite(traceFile,1,nameLen,fp);
+        fwrite(&usedSets,sizeof(usedSets),1,fp);
+        for (unsigned int i = 0 ; i < numberOfSets; i++) 
+        { 
+                if (Sets[i] == NULL) 
+                { 
+                        continue;
+                }
+                fwrite(&i,sizeof(i),1,fp);
+                for (int j = 0 ; j < numLines; j++) 
+                { 
+                        unsigned char valid = Sets[i][j].valid;
+                        fwrite(&valid,sizeof(valid),1,fp);
+                        fwrite(&Sets[i][j].tag,sizeof(Sets[i][j].tag),1,fp);
+                        fwrite(&Sets[i][j].count,sizeof(Sets[i][j].count),1,
+                                        fp);
+                }
+        }
+        if (ferror(fp) | fclose(fp) || rename(tmpName,fileName)) 
+        { 
+                printf("Unable to write checkpoint file %s\n",fileName);
+                exit(-1);
+        }
+}
+
+/*
+ * loadCheckpoint : Restoring cache state from the checkpoint file
+ * Sets must be freshly allocated (all NULL). Trace offset is only 
+ * returned when the checkpoint was taken on the same trace file, so a 
+ * prefix-warmed cache can be resumed on a different suffix trace
+ * Input : Array of Sets, checkpoint filename
+ * Output : Trace offset to resume from
+ */
+
+long loadCheckpoint(Set * Sets, char * fileName) 
+{ 
+        char magic[sizeof(CKPT_MAGIC) - 1];
+        char name[FILENAME_MAX];
+        unsigned int numberOfSets = 1 << setBits;
+        unsigned int nameLen, usedSets, index;
+        int shortLines;
+        long long hdr[9];
+        int ok = 1;
+
+        FILE * fp = fopen(fileName,"rb");
+        if (fp == NULL) 
+        { 
+                printf("Unable to open checkpoint file %s\n",fileName);
+                exit(-1);
+        }
+        ok = ok && fread(magic,1,sizeof(magic),fp) == sizeof(magic);
+        ok = ok && !memcmp(magic,CKPT_MAGIC,sizeof(magic));
+        ok = ok && fread(&shortLines,sizeof(shortLines),1,fp) == 1;
+        ok = ok && fread(hdr,sizeof(hdr[0]),9,fp) == 9;
+        ok = ok && fread(&nameLen,sizeof(nameLen),1,fp) == 1;
+        ok = ok && nameLen < sizeof(name);
+        ok = ok && fread(name,1,nameLen,fp) == nameLen;
+        ok = ok && fread(&usedSets,sizeof(usedSets),1,fp) == 1;
+        if (!ok) 
+        { 
+                printf("Bad checkpoint file %s\n",fileName);
+                exit(-1);
+        }
+        name[nameLen] = '\0';
+        if ((hdr[0] != setBits) || (hdr[1] != blockBits) || 
+                        (shortLines != numLines) || 
+                        (hdr[8] != (splitMask != 0))) 
+        { 
+                printf("Checkpoint %s was taken with -s %lld -E %d -b %lld%s\n",
+                                fileName,hdr[0],shortLines,hdr[1],
+                                hdr[8] ? " -x" : "");
+                exit(-1);
+        }
+        timestamp = hdr[2];
+        numOfHits = hdr[3];
+        numOfMisses = hdr[4];
+        numOfEvicts = hdr[5];
+        numOfAccesses = hdr[6];
+
+        for (unsigned int i = 0 ; ok && i < usedSets; i++) 
+        { 
+                ok = fread(&index,sizeof(index),1,fp) == 1 && 
+                        index < numberOfSets && Sets[index] == NULL;
+                if (!ok) 
+                { 
+                        break;
+                }
+                Sets[index] = (Line *) malloc(numLines * sizeof(Line ));
+                if (Sets[index] == NULL) 
+                { 
+                        printf("Unable to allocate memory for line for Set %u"
+                                        ,index);
+                        exit(-1);
+                }
+                for (int j = 0 ; ok && j < numLines; j++) 
+                { 
+                        unsigned char valid;
+                        ok = fread(&valid,sizeof(valid),1,fp) == 1 &&
+                          fread(&Sets[index][j].tag,
+                                  sizeof(Sets[index][j].tag),1,fp) == 1 &&
+                          fread(&Sets[index][j].count,
+                                  sizeof(Sets[index][j].count),1,fp) == 1;
+                        Sets[index][j].valid = valid;
+                }
+        }
+        fclose(fp);
+        if (!ok) 
+        { 
+                printf("Truncated checkpoint file %s\n",fileName);
+                exit(-1);
+        }
+        return strcmp(name,traceFile) ? 0 : (long)hdr[7];
+}
+
+/*
+ * writeInterval : Writing counters of the interval ending at the current
+ * access. Counters of the previous interval end are kept in statics, a 
+ * NULL file only records the current counters as the interval start
+ * Input : Interval stats file
+ * Output : None
+ */
+
+void writeInterval(FILE * fp) 
+{ 
+        static unsigned long long lastHits, lastMisses, lastEvicts;
+        unsigned long long rec[4] = {numOfAccesses, numOfHits - lastHits,
+                numOfMisses - lastMisses, numOfEvicts - lastEvicts};
+
+        lastHits = numOfHits;
+        lastMisses = numOfMisses;
+        lastEvicts = numOfEvicts;
+        if (fp == NULL) 
+        { 
+                return;
+        }
+        if (intervalBinary) 
+        { 
+                fwrite(rec,sizeof(rec[0]),4,fp);
+        } 
+        else 
+        {
+                fprintf(fp,"%llu,%llu,%llu,%llu,%.6f\n",rec[0],rec[1],
+                                rec[2],rec[3],(rec[1] + rec[2]) ? 
+                                (double)rec[2] / (rec[1] + rec[2]) : 0.0);
+        }
+}
+
+/*
+ * readTraceLine : Lines look like " L 10,4" for data accesses and 
+ * "I  0400d7d4,8" for instruction loads
+ */
+
+static int readTraceLine(FILE * fp, char * op, Long * addr, unsigned int * size) 
+{ 
+        int c;
+        char ch; //Garbage value to contain '\n' at the end of line
+
+        while ((c = fgetc(fp)) != EOF) 
+        { 
+                if (fscanf(fp," %c %llx,%u%c",op,addr,size,&ch) < 1) 
+                        return 0;
+                if (c != 'I') 
+                        return 1;
+        }
+        return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * rdist.c - Reuse distance and working set profile of a memory trace
+ *
+ * Reads a valgrind trace (the same way csim does, skipping instruction
+ * loads) and computes, at line and page granularity, the histogram of reuse
+ * distances (number of distinct lines/pages touched between two
+ * accesses to the same line/page) and the working set curve, i.e. the
+ * miss ratio of a fully associative LRU cache of 1, 2, 4, ... lines.
+ *
+ * Exact mode uses a Fenwick tree indexed by access time: the last
+ * access of every line is marked, so the distance of an access is the
+ * number of marks after the previous access of the same line, giving
+ * O(n log n) overall. Approximate mode (-a rate) only tracks lines whose
+ * hash falls below rate (spatial sampling). Distances count distinct
+ * lines, so they are scaled by 1/rate, but counts are scaled by the
+ * number of accesses over the number actually sampled, so the histogram
+ * always adds up to the trace length (SHARDS-adj) even when hot lines
+ * are over or under sampled. A sampled distance d stands for a real one
+ * of about d/rate, so distances below 1/rate cannot be told apart from
+ * 0 : they are counted as 0 and the working set curve starts at the
+ * first size not below 1/rate.
+ *
+ * e.g. : ./rdist -b 6 -p 12 -t traces/long.trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+/*
+ * Number of power of two histogram buckets : bucket 0 holds distance 0,
+ * bucket k holds distances [2^(k-1), 2^k)
+ */
+#define NBUCKETS 66
+
+typedef unsigned long long Long;
+
+/*
+ * Command line options
+ */
+static int blockBits = 6;       /* line size bits (-b 6) */
+static int pageBits = 12;       /* page size bits (-p 12) */
+static double sampleRate = 1.0; /* fraction of lines tracked (-a 0.01) */
+static char *traceFile = NULL;  /* trace file (-t trace/file1) */
+
+/*
+ * Trace held in memory : address of every access (M counts twice)
+ */
+static Long *addrs = NULL;
+static Long numAddrs = 0;
+
+/*
+ * Open addressing hash table from line number to time of last access
+ */
+typedef struct {
+    Long key;   /* line number + 1, 0 for an empty slot */
+    Long time;  /* time of the last access (1 based) */
+} slot_t;
+
+static slot_t *table = NULL;
+static Long tableMask = 0;
+
+/*
+ * Fenwick tree over access times, marks last access of every line
+ */
+static int *fenwick = NULL;
+static Long fenwickSize = 0;
+
+/*
+ * hashLine - 64 bit mix of a line number, used for the hash table and
+ *     for sampling
+ */
+static Long hashLine(Long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * readTraceLine - Read the next data access from a trace file. Lines
+ *     look like " L 10,4" for data accesses and "I  0400d7d4,8" for
+ *     instruction loads, which are skipped. Returns 1 if an access was
+ *     read, 0 at end of file.
+ */
+static int readTraceLine(FILE *fp, char *op, Long *addr, unsigned int *size)
+{
+    int c;
+    char ch; /* newline at the end of the line */
+
+    while ((c = fgetc(fp)) != EOF) {
+        if (fscanf(fp, " %c %llx,%u%c", op, addr, size, &ch) < 1)
+            return 0;
+        if (c != 'I')
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * lookupLine - Return the slot of line x, inserting an empty one
+ */
+static slot_t *lookupLine(Long x)
+{
+    Long i = hashLine(x) & tableMask;
+    while (table[i].key != 0 && table[i].key != x + 1)
+        i = (i + 1) & tableMask;
+    table[i].key = x + 1;
+    return &table[i];
+}
+
+static void fenwickAdd(Long i, int v)
+{
+    for (; i <= fenwickSize; i += i & -i)
+        fenwick[i] += v;
+}
+
+static Long fenwickSum(Long i)
+{
+    Long sum = 0;
+    for (; i > 0; i -= i & -i)
+        sum += fenwick[i];
+    return sum;
+}
+
+/*
+ * bucketOf - Histogram bucket of a distance
+ */
+static int bucketOf(Long d)
+{
+    return d ? 64 - __builtin_clzll(d) : 0;
+}
+
+/*
+ * readTrace - Load every data access of the trace into addrs
+ */
+static void readTrace(void)
+{
+    FILE *fp;
+    char op;
+    Long addr;
+    unsigned int size;
+    Long cap = 1 << 16;
+
+    if ((fp = fopen(traceFile, "r")) == NULL) {
+        printf("Unable to open the file %s\n", traceFile);
+        exit(-1);
+    }
+    if ((addrs = malloc(cap * sizeof(Long))) == NULL) {
+        printf("Unable to alloc memory for trace\n");
+        exit(-1);
+    }
+    while (readTraceLine(fp, &op, &addr, &size)) {
+        int n = (op == 'M') ? 2 : 1;
+        if (numAddrs + n > cap) {
+            cap *= 2;
+            if ((addrs = realloc(addrs, cap * sizeof(Long))) == NULL) {
+                printf("Unable to alloc memory for trace\n");
+                exit(-1);
+            }
+        }
+        while (n--)
+            addrs[numAddrs++] = addr;
+    }
+    fclose(fp);
+}
+
+/*
+ * profile - Compute and print the histogram and working set curve at
+ *     a granularity of 2^bits bytes
+ */
+static void profile(const char *name, int bits)
+{
+    double hist[NBUCKETS];
+    double cold = 0, total = 0, hits = 0, weight;
+    Long threshold = (sampleRate < 1.0) ?
+        (Long)(sampleRate * 18446744073709551616.0) : ~0ULL;
+    Long t = 0, n = 0, i;
+    int k, maxBucket = 0, minBucket = 0;
+
+    /* Count the sampled accesses first, they size the table and tree */
+    for (i = 0; i < numAddrs; i++)
+        if (hashLine((addrs[i] >> bits) ^ 0x9e3779b97f4a7c15ULL) <= threshold)
+            n++;
+    weight = n ? (double)numAddrs / n : 0.0;
+
+    memset(hist, 0, sizeof(hist));
+    for (tableMask = 1; tableMask < 2 * n; tableMask <<= 1)
+        ;
+    table = calloc(tableMask, sizeof(slot_t));
+    tableMask--;
+    fenwickSize = n;
+    fenwick = calloc(fenwickSize + 1, sizeof(int));
+    if (table == NULL || fenwick == NULL) {
+        printf("Unable to alloc memory for %s profile\n", name);
+        exit(-1);
+    }
+
+    for (i = 0; i < numAddrs; i++) {
+        Long x = addrs[i] >> bits;
+        slot_t *s;
+
+        /* Sampled out lines are neither counted nor timestamped */
+        if (hashLine(x ^ 0x9e3779b97f4a7c15ULL) > threshold)
+            continue;
+
+        t++;
+        s = lookupLine(x);
+        if (s->time == 0) {
+            cold++;
+        } else {
+            Long d = fenwickSum(t - 1) - fenwickSum(s->time);
+            d = (Long)(d / sampleRate);
+            k = bucketOf(d);
+            hist[k]++;
+            maxBucket = (k > maxBucket) ? k : maxBucket;
+            fenwickAdd(s->time, -1);
+        }
+        fenwickAdd(t, 1);
+        s->time = t;
+    }
+
+    /* Every sampled access stands for numAddrs / n accesses */
+    for (k = 0; k <= maxBucket; k++) {
+        hist[k] *= weight;
+        total += hist[k];
+    }
+    cold *= weight;
+    total += cold;
+    while ((double)(1ULL << minBucket) * sampleRate < 1.0 &&
+           minBucket < maxBucket)
+        minBucket++;
+
+    printf("# %s granularity (%d bytes)%s\n", name, 1 << bits,
+           sampleRate < 1.0 ? ", approximate" : "");
+    if (n == 0)
+        printf("# no %s sampled, use a larger rate\n", name);
+    if (minBucket > 0)
+        printf("# distances below %.0f are counted as 0\n", 1.0 / sampleRate);
+    printf("distance,accesses\n");
+    for (k = 0; k <= maxBucket; k++)
+        if (k == 0 || k >= minBucket)
+            printf("%llu,%.0f\n", k ? 1ULL << (k - 1) : 0ULL, hist[k]);
+    printf("cold,%.0f\n", cold);
+
+    /* An LRU cache of 2^k entries hits every access with distance < 2^k */
+    printf("# %s working set curve\n", name);
+    printf("entries,bytes,miss_ratio\n");
+    for (k = 0; k <= maxBucket; k++) {
+        hits += hist[k];
+        if (k >= minBucket)
+            printf("%llu,%llu,%.6f\n", 1ULL << k, (1ULL << k) << bits,
+                   total ? 1.0 - hits / total : 0.0);
+    }
+
+    free(table);
+    free(fenwick);
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-b <bits>] [-p <bits>] [-a <rate>] -t <file>\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -b <bits>  Line size bits (default 6).\n");
+    printf("  -p <bits>  Page size bits (default 12).\n");
+    printf("  -a <rate>  Approximate: sample this fraction of lines.\n");
+    printf("  -t <file>  Trace file.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "b:p:a:t:h"))) {
+        switch (opt) {
+        case 'b':
+            blockBits = atoi(optarg);
+            break;
+        case 'p':
+            pageBits = atoi(optarg);
+            break;
+        case 'a':
+            sampleRate = atof(optarg);
+            break;
+        case 't':
+            traceFile = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (traceFile == NULL || sampleRate <= 0.0 || sampleRate > 1.0) {
+        usage(argv);
+        exit(1);
+    }
+
+    readTrace();
+    profile("line", blockBits);
+    profile("page", pageBits);
+    free(addrs);
+    return 0;
+}
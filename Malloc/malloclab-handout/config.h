@@ -102,14 +102,20 @@
 #define UTIL_WEIGHT .61
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (8, or 16 in the 64-bit mode)
  */
+#ifdef MM_64
+#define ALIGNMENT 16            /* 64-bit mode of mm.c */
+#else
 #define ALIGNMENT 8
+#endif
 
 /*
  * Maximum heap size in bytes
  */
+#ifndef MAX_HEAP                /* libmm.so sets its own */
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
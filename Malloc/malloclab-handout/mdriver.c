@@ -18,13 +18,29 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
 
+/* 
+ * The older allocators of the directory (make variants) have no region 
+ * arenas, their drivers are linked without them and fail the traces
+ * which use them
+ */
+#pragma weak mm_arena_create
+#pragma weak mm_arena_alloc
+#pragma weak mm_arena_reset
+#pragma weak mm_arena_destroy
+#pragma weak mm_checkheap_incr
+
 /**********************
  * Constants and macros
  **********************/
@@ -33,6 +49,7 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define LAT_WORST     10 /* slowest requests printed by -L */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
@@ -54,34 +71,80 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, in a splay tree ordered by
+   address (the payloads never overlap) */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
     int index;             /* same index as free; for debugging */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/*
+ * Characterizes a single trace operation (allocator request). Besides
+ * "a id size", "r id size" and "f id", a trace may use region arenas :
+ * "b k id size" allocates block id from arena k (mm_arena_alloc, the 
+ * arena is created on its first use), "z k" resets arena k and "d k" 
+ * destroys it, both dropping all its blocks. The blocks of an arena are
+ * never freed or reallocated on their own. Every field fits in 12 bytes,
+ * which keeps binary traces (below) close to the size of the text ones
+ */
+enum { ALLOC, FREE, REALLOC, ARENA_ALLOC, ARENA_RESET, ARENA_DESTROY };
+
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
     int index;                        /* index for free() to use later */
-    size_t size;                      /* byte size of alloc/realloc request */
+    int size;                         /* byte size of alloc/realloc request */
+    unsigned short arena;             /* region arena of b, z and d */
+    unsigned char type;               /* of request, ALLOC ... */
 } traceop_t;
 
+#define MAX_ARENAS 65536              /* region arenas a trace may use */
+
+#define NUM_TYPES (ARENA_DESTROY + 1)
+
 /* Holds the information for one trace file*/
 typedef struct {
     char filename[MAXLINE];
-    int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+    int ignore_ranges;   /* don't check every block after each request
+                            with -D (i.e. this is too big) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
+    int num_arenas;      /* number of region arenas used by b, z and d */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
+    mm_arena_t **arenas; /* region arenas, NULL until their first block */
+    int *arena_first;    /* last block allocated in each arena, and ... */
+    int *block_next;     /* ... the one before, -1 ending the chain */
+    int *block_arena;    /* arena of each block, -1 if not in an arena */
+    void *map;           /* mapped binary trace that ops points into ... */
+    size_t map_len;      /* ... and its length (NULL, 0 if ops is malloced) */
 } trace_t;
 
+/*
+ * Binary traces (name.bin next to name.rep, written by mdriver -B): this
+ * header followed by the num_ops requests as traceop_t, so that the file
+ * can be mapped and used as trace->ops as it is. op_size catches a file
+ * written by a driver with another traceop_t layout. The requests are 
+ * kept as they are in memory rather than compressed : a binary trace is
+ * about 1.3 times the size of the text one (12 bytes a request), the
+ * price of loading it without parsing or copying
+ */
+#define BIN_MAGIC "MMTRACE2"
+
+typedef struct {
+    char magic[8];
+    int weight;
+    int num_ids;
+    int num_ops;
+    int ignore_ranges;
+    int op_size;         /* sizeof(traceop_t) */
+    int num_arenas;      /* also keeps the requests 8 byte aligned */
+} binhdr_t;
+
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -105,6 +168,8 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double heap;     /* heap bytes at the end of the utilization run */
+    double rss;      /* resident heap bytes at the end of that run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -130,6 +195,9 @@ static randint_t random_data[RANDOM_DATA_LEN];
 
 static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
 
+/* call mm_checkheap_incr after every request of the validation (-C) */
+static int incr_check = 0;
+
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 int onetime_flag = 0;
@@ -137,6 +205,16 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* write the traces as binary traces and exit (-B) */
+static int convert_flag = 0;
+
+/* traces evaluated at once, each in a process of its own (-j) */
+static int jobs = 1;
+static int running_jobs = 0;
+
+/* time every request of the traces and print their distribution (-L) */
+static int latency_flag = 0;
+
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -148,15 +226,29 @@ static char *default_tracefiles[] = {
 
 char autoresult[MAXLINE]; /* autoresult string */
 
+#ifdef MM_STATS
+/* eval_mm_util remembers the op of its high water mark and takes the 
+ * mm_stats of the heap after op stats_op */
+static int peak_op = 0;
+static int stats_op = -1;
+static mm_stats_t peak_stats;
+
+/* with -M, eval_mm_util writes the heap map to map_fp every map_ops ops */
+static int map_ops = 0;
+static FILE *map_fp = NULL;
+#endif
+
 /*********************
  * Function prototypes
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size,
                      const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void check_ranges(range_t *t, const trace_t *trace, int opnum);
+static range_t *splay_range(range_t *t, char *lo);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -168,6 +260,10 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
+static int map_trace(trace_t *trace);
+static void write_trace(trace_t *trace);
+static void arena_push(trace_t *trace, int arena, int index);
+static void arena_error(const trace_t *trace, int opnum, int index);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace);
@@ -178,6 +274,12 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace);
+static int cmp_cycles(const void *a, const void *b);
+#ifdef MM_STATS
+static void eval_mm_stats(trace_t *trace, int tracenum);
+static void eval_mm_heapmap(trace_t *trace, int tracenum);
+#endif
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
@@ -198,15 +300,73 @@ static void timeout_handler(int sig __attribute__((unused))) {
     longjmp(timeout_jmpbuf, 1);
 }
 
+/*
+ * wait_jobs - Waits for trace processes until at most n run. The exit
+ *   status of a process is its number of errors; the trace of a process 
+ *   that did not exit is invalid.
+ */
+static void wait_jobs(pid_t *pids, int num_tracefiles, stats_t *mm_stats,
+                      int n) {
+    int i, status;
+    pid_t pid;
+
+    while (running_jobs > n) {
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait failed in wait_jobs");
+        running_jobs--;
+        for (i = 0; i < num_tracefiles && pids[i] != pid; i++)
+            ;
+        if (WIFEXITED(status)) {
+            errors += WEXITSTATUS(status);
+        } else {
+            fprintf(stderr, "Trace %d was killed by signal %d\n", i,
+                    WTERMSIG(status));
+            errors++;
+            if (i < num_tracefiles)
+                mm_stats[i].valid = 0;
+        }
+    }
+}
+
 /* Run the tests; return the number of tests run (may be less than
-   num_tracefiles, if there's a timeout) */
+   num_tracefiles, if there's a timeout). With -j each trace is checked
+   in a child process, with its own memory system, which writes its stats
+   to shared memory; the timeout then applies to each trace. The valid
+   traces are then timed one at a time by the parent, so that no trace is
+   timed while another one runs on a sibling cpu or shares its caches. */
 static void run_tests(int num_tracefiles, const char *tracedir,
                       char **tracefiles, 
                       stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
     volatile int i;
     volatile int timed_out = 0;
+    stats_t *results = mm_stats;
+    pid_t *pids = NULL;
+
+    if (jobs > 1 && !onetime_flag) {
+        mm_stats = mmap(NULL, num_tracefiles * sizeof(stats_t),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+        if (mm_stats == MAP_FAILED)
+            unix_error("mmap failed in run_tests");
+        if ((pids = calloc(num_tracefiles, sizeof(pid_t))) == NULL)
+            unix_error("calloc failed in run_tests");
+        alarm(0);
+    }
 
     for (i=0; i < num_tracefiles; i++) {
+        if (pids != NULL) {
+            wait_jobs(pids, num_tracefiles, mm_stats, jobs - 1);
+            fflush(stdout);
+            if ((pids[i] = fork()) < 0)
+                unix_error("fork failed in run_tests");
+            if (pids[i] > 0) {
+                running_jobs++;
+                continue;
+            }
+            if (set_timeout > 0)
+                alarm(set_timeout);
+        }
+
         /* initialize simulated memory system in memlib.c *
          * start each trace with a clean system */
         mem_init();
@@ -236,17 +396,62 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].heap = mem_heapsize();
+            mm_stats[i].rss = mem_rss();
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            if (pids == NULL)
+                mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+#ifdef MM_STATS
+            if (verbose > 1)
+                eval_mm_stats(trace, i);
+            if (map_ops > 0)
+                eval_mm_heapmap(trace, i);
+#endif
+            if (latency_flag && pids == NULL)
+                eval_mm_latency(trace);
         }
 
         free_trace(trace);
 
         /* clean up memory system */
         mem_deinit();
+
+        if (pids != NULL) {
+            fflush(stdout);
+            _exit(errors < 255 ? errors : 255);
+        }
+    }
+
+    if (pids != NULL) {
+        wait_jobs(pids, num_tracefiles, mm_stats, 0);
+        for (i = 0; i < num_tracefiles; i++) {
+            trace_t *trace;
+
+            if (!mm_stats[i].valid)
+                continue;
+            mem_init();
+            trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
+            if (set_timeout > 0)
+                alarm(set_timeout);
+            if (setjmp(timeout_jmpbuf) != 0) {
+                mm_stats[i].valid = 0;
+            } else {
+                speed_params->trace = trace;
+                speed_params->ranges = ranges;
+                mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+                if (latency_flag)
+                    eval_mm_latency(trace);
+            }
+            alarm(0);
+            free_trace(trace);
+            mem_deinit();
+        }
+        memcpy(results, mm_stats, num_tracefiles * sizeof(stats_t));
+        munmap(mm_stats, num_tracefiles * sizeof(stats_t));
+        free(pids);
     }
 }
 
@@ -280,7 +485,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:j:s:t:v:hVABCLlDM:")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -334,10 +539,34 @@ int main(int argc, char **argv)
             debug_mode = DBG_EXPENSIVE;
             break;
 
+        case 'C': /* Check the heap incrementally */
+            if (mm_checkheap_incr == NULL)
+                app_error("the allocator has no mm_checkheap_incr");
+            incr_check = 1;
+            break;
+
         case 's':
             set_timeout = atoi(optarg);
             break;
 
+        case 'B': /* Write binary traces */
+            convert_flag = 1;
+            break;
+
+        case 'j': /* Evaluate traces in parallel */
+            jobs = atoi(optarg);
+            break;
+
+        case 'L': /* Latency of each request */
+            latency_flag = 1;
+            break;
+
+#ifdef MM_STATS
+        case 'M': /* Heap map every n ops */
+            map_ops = atoi(optarg);
+            break;
+#endif
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -354,10 +583,24 @@ int main(int argc, char **argv)
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    if (convert_flag) {
+        for (i = 0; i < num_tracefiles; i++) {
+            stats_t stats;
+            trace_t *trace = read_trace(&stats, tracedir, tracefiles[i]);
+            write_trace(trace);
+            free_trace(trace);
+        }
+        exit(0);
+    }
+
     if(debug_mode != DBG_NONE) {
         init_random_data();
     }
 
+    /* More processes than cpus would only wait for each other */
+    if (jobs < 1 || jobs > sysconf(_SC_NPROCESSORS_ONLN))
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -546,9 +789,11 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * splay tree, so that each request costs O(log n) amortized instead
+ * of a scan of every live block.
  ****************************************************************/
 
 /*
@@ -561,7 +806,7 @@ static int add_range(range_t **ranges, char *lo, int size,
                      const trace_t *trace, int opnum, int index)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *t;
 
     assert(size > 0);
 
@@ -581,15 +826,21 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
-       just assume the overlap will be caught by writing random bits. */
-    if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
-
-
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
+    if(debug_mode == DBG_NONE) return 1;
+
+    /* The payload must not overlap any other payloads. Once lo is splayed
+       to the root, only the root and its neighbour on the other side of lo
+       (the last range before it or the first one after it) can overlap */
+    if ((t = *ranges) != NULL) {
+        t = *ranges = splay_range(t, lo);
+        p = t;
+        if (t->lo <= lo && lo > t->hi)
+            for (p = t->right; p != NULL && p->left != NULL; p = p->left)
+                ;
+        else if (t->lo > lo && hi < t->lo)
+            for (p = t->left; p != NULL && p->right != NULL; p = p->right)
+                ;
+        if (p != NULL && lo <= p->hi && hi >= p->lo) {
             malloc_error(trace, opnum,
                          "Payload (%p:%p) overlaps another payload (%p:%p)\n",
                          lo, hi, p->lo, p->hi);
@@ -599,14 +850,23 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     /*
      * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and making it the root of the tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
     p->index = index;
+    p->left = p->right = NULL;
+    if (t != NULL && t->lo < lo) {
+        p->left = t;
+        p->right = t->right;
+        t->right = NULL;
+    } else if (t != NULL) {
+        p->right = t;
+        p->left = t->left;
+        t->left = NULL;
+    }
     *ranges = p;
 
     return 1;
@@ -618,16 +878,21 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    if (*ranges == NULL)
+        return;
+    p = *ranges = splay_range(*ranges, lo);
+    if (p->lo != lo)
+        return;
+
+    /* The largest range below lo has no right child once splayed */
+    if (p->left == NULL) {
+        *ranges = p->right;
+    } else {
+        *ranges = splay_range(p->left, lo);
+        (*ranges)->right = p->right;
     }
+    free(p);
 }
 
 /*
@@ -636,13 +901,95 @@ static void remove_range(range_t **ranges, char *lo)
 static void clear_ranges(range_t **ranges)
 {
     range_t *p;
-    range_t *pnext;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    /* Rotates the left children up, so that no stack is needed */
+    while ((p = *ranges) != NULL) {
+        if (p->left != NULL) {
+            *ranges = p->left;
+            p->left = (*ranges)->right;
+            (*ranges)->right = p;
+        } else {
+            *ranges = p->right;
+            free(p);
+        }
+    }
+}
+
+/*
+ * check_ranges - check_index of every range of the tree rooted at t. The
+ *     walk threads each left subtree to its parent on the way down and
+ *     undoes it on the way up (Morris), so it needs no stack however deep
+ *     the tree is
+ */
+static void check_ranges(range_t *t, const trace_t *trace, int opnum)
+{
+    range_t *p;
+
+    while (t != NULL) {
+        if (t->left != NULL) {
+            for (p = t->left; p->right != NULL && p->right != t; p = p->right)
+                ;
+            if (p->right == NULL) {
+                p->right = t;
+                t = t->left;
+                continue;
+            }
+            p->right = NULL;
+        }
+        check_index(trace, opnum, t->index);
+        t = t->right;
+    }
+}
+
+/*
+ * splay_range - top down splay of the tree rooted at t for address lo.
+ *     Returns the new root, which is the range at lo when there is one or
+ *     else the last range before or the first range after lo
+ */
+static range_t *splay_range(range_t *t, char *lo)
+{
+    range_t n, *l, *r, *y;
+
+    n.left = n.right = NULL;
+    l = r = &n;
+    for (;;) {
+        if (lo < t->lo) {
+            if (t->left == NULL)
+                break;
+            if (lo < t->left->lo) {     /* rotate right */
+                y = t->left;
+                t->left = y->right;
+                y->right = t;
+                t = y;
+                if (t->left == NULL)
+                    break;
+            }
+            r->left = t;                /* link right */
+            r = t;
+            t = t->left;
+        } else if (lo > t->lo) {
+            if (t->right == NULL)
+                break;
+            if (lo > t->right->lo) {    /* rotate left */
+                y = t->right;
+                t->right = y->left;
+                y->left = t;
+                t = y;
+                if (t->right == NULL)
+                    break;
+            }
+            l->right = t;               /* link left */
+            l = t;
+            t = t->right;
+        } else {
+            break;
+        }
     }
-    *ranges = NULL;
+    l->right = t->left;                 /* assemble */
+    r->left = t->right;
+    t->left = n.right;
+    t->right = n.left;
+    return t;
 }
 
 /**********************************************
@@ -720,8 +1067,9 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     FILE *tracefile;
     trace_t *trace;
     char type[MAXLINE];
-    int index, size;
+    int index, size, arena;
     int max_index = 0;
+    int max_arena = -1;
     int op_index;
 
     if (verbose > 1)
@@ -734,13 +1082,23 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     /* Read the trace file header */
     strcpy(trace->filename, tracedir);
     strcat(trace->filename, filename);
-    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
-        unix_error("Could not open %s in read_trace", trace->filename);
+    trace->map = NULL;
+    trace->map_len = 0;
+    tracefile = NULL;
+    if (!map_trace(trace)) {
+        if ((tracefile = fopen(trace->filename, "r")) == NULL) {
+            unix_error("Could not open %s in read_trace", trace->filename);
+        }
+        fscanf(tracefile, "%d", &trace->weight);
+        fscanf(tracefile, "%d", &trace->num_ids);
+        fscanf(tracefile, "%d", &trace->num_ops);
+        fscanf(tracefile, "%d", &trace->ignore_ranges);
+
+        /* We'll store each request line in the trace in this array */
+        if ((trace->ops =
+             (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
+            unix_error("malloc 2 failed in read_trace");
     }
-    fscanf(tracefile, "%d", &trace->weight);
-    fscanf(tracefile, "%d", &trace->num_ids);
-    fscanf(tracefile, "%d", &trace->num_ops);
-    fscanf(tracefile, "%d", &trace->ignore_ranges);
 
     if(trace->weight < 0 || trace->weight > 3) {
         app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
@@ -749,11 +1107,6 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
         app_error("%s: ignore-ranges can only be zero or one", trace->filename);
     }
 
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops =
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
-
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks =
          (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
@@ -769,6 +1122,29 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
+    /* the blocks of each region arena are chained through block_next */
+    if ((trace->block_next = malloc(trace->num_ids * sizeof(int))) == NULL ||
+        (trace->block_arena = malloc(trace->num_ids * sizeof(int))) == NULL)
+        unix_error("malloc 6 failed in read_trace");
+    trace->arenas = NULL;
+    trace->arena_first = NULL;
+
+    /* A binary trace only gets its requests checked */
+    if (tracefile == NULL) {
+        for (op_index = 0; op_index < trace->num_ops; op_index++) {
+            index = trace->ops[op_index].index;
+            arena = trace->ops[op_index].arena;
+            if ((unsigned)trace->ops[op_index].type >= NUM_TYPES ||
+                index >= trace->num_ids ||
+                (index < 0 && trace->ops[op_index].type != FREE &&
+                 trace->ops[op_index].type < ARENA_RESET) ||
+                (trace->ops[op_index].type >= ARENA_ALLOC &&
+                 (arena < 0 || arena >= trace->num_arenas)))
+                app_error("Bad request %d in binary trace %s", op_index,
+                          trace->filename);
+        }
+        goto arenas;
+    }
 
     /* read every request line in the trace file */
     index = 0;
@@ -794,6 +1170,30 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
             break;
+        case 'b':
+            fscanf(tracefile, "%u %u %u", &arena, &index, &size);
+            if (arena >= MAX_ARENAS)
+                app_error("%s: arena %d is not below %d", trace->filename,
+                          arena, MAX_ARENAS);
+            trace->ops[op_index].type = ARENA_ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].arena = arena;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            max_arena = (arena > max_arena) ? arena : max_arena;
+            break;
+        case 'z':
+        case 'd':
+            fscanf(tracefile, "%u", &arena);
+            if (arena >= MAX_ARENAS)
+                app_error("%s: arena %d is not below %d", trace->filename,
+                          arena, MAX_ARENAS);
+            trace->ops[op_index].type = type[0] == 'z' ? ARENA_RESET :
+                                                         ARENA_DESTROY;
+            trace->ops[op_index].index = -1;
+            trace->ops[op_index].arena = arena;
+            max_arena = (arena > max_arena) ? arena : max_arena;
+            break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
@@ -804,6 +1204,14 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    trace->num_arenas = max_arena + 1;
+
+arenas:
+    if ((trace->arenas = calloc(trace->num_arenas + 1,
+                                sizeof(mm_arena_t *))) == NULL ||
+        (trace->arena_first = malloc((trace->num_arenas + 1) *
+                                     sizeof(int))) == NULL)
+        unix_error("malloc 7 failed in read_trace");
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
@@ -821,6 +1229,20 @@ static void reinit_trace(trace_t *trace)
     memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
     memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
     /* block_rand_base is unused if size is zero */
+    memset(trace->block_arena, -1, trace->num_ids * sizeof(int));
+    memset(trace->arena_first, -1, trace->num_arenas * sizeof(int));
+    /* the arenas were in the heap which is about to be reset */
+    memset(trace->arenas, 0, trace->num_arenas * sizeof(mm_arena_t *));
+}
+
+/*
+ * arena_push - Records that block index was allocated from region arena
+ */
+static void arena_push(trace_t *trace, int arena, int index)
+{
+    trace->block_arena[index] = arena;
+    trace->block_next[index] = trace->arena_first[arena];
+    trace->arena_first[arena] = index;
 }
 
 /*
@@ -829,13 +1251,111 @@ static void reinit_trace(trace_t *trace)
  */
 static void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the three arrays... */
+        munmap(trace->map, trace->map_len);
+    else
+        free(trace->ops);
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
+    free(trace->block_next);
+    free(trace->block_arena);
+    free(trace->arenas);
+    free(trace->arena_first);
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * bin_name - name.bin for a trace file name.rep, NULL for other names
+ */
+static char *bin_name(const char *filename, char *buf)
+{
+    size_t len = strlen(filename);
+
+    if (len < 4 || strcmp(filename + len - 4, ".rep") != 0)
+        return NULL;
+    strcpy(buf, filename);
+    strcpy(buf + len - 4, ".bin");
+    return buf;
+}
+
+/*
+ * map_trace - Maps the binary trace of trace->filename if there is one at
+ *     least as recent as the text trace, and points trace->ops at its 
+ *     requests. Returns 0 if the text trace must be read instead.
+ */
+static int map_trace(trace_t *trace)
+{
+    char name[MAXLINE];
+    struct stat rep, bin;
+    binhdr_t *hdr;
+    int fd;
+
+    if (convert_flag || bin_name(trace->filename, name) == NULL ||
+        stat(name, &bin) < 0 || stat(trace->filename, &rep) < 0 ||
+        bin.st_mtime < rep.st_mtime || (size_t)bin.st_size < sizeof(*hdr))
+        return 0;
+    if ((fd = open(name, O_RDONLY)) < 0)
+        return 0;
+    hdr = mmap(NULL, bin.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+        unix_error("mmap of %s failed in map_trace", name);
+
+    if (memcmp(hdr->magic, BIN_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->op_size != sizeof(traceop_t) || hdr->num_ops < 0 ||
+        hdr->num_arenas < 0 ||
+        (size_t)bin.st_size != sizeof(*hdr) +
+        (size_t)hdr->num_ops * sizeof(traceop_t)) {
+        fprintf(stderr, "Ignoring %s: not a binary trace of this driver\n",
+                name);
+        munmap(hdr, bin.st_size);
+        return 0;
+    }
+    if (verbose > 1)
+        printf("Mapped binary trace: %s\n", name);
+
+    trace->weight = hdr->weight;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->ignore_ranges = hdr->ignore_ranges;
+    trace->num_arenas = hdr->num_arenas;
+    trace->ops = (traceop_t *)(hdr + 1);
+    trace->map = hdr;
+    trace->map_len = bin.st_size;
+    return 1;
+}
+
+/*
+ * write_trace - Writes the binary trace name.bin of a trace read from
+ *     name.rep (mdriver -B)
+ */
+static void write_trace(trace_t *trace)
+{
+    char name[MAXLINE];
+    binhdr_t hdr;
+    FILE *fp;
+
+    if (bin_name(trace->filename, name) == NULL)
+        app_error("%s is not a .rep trace", trace->filename);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+    hdr.weight = trace->weight;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.ignore_ranges = trace->ignore_ranges;
+    hdr.op_size = sizeof(traceop_t);
+    hdr.num_arenas = trace->num_arenas;
+
+    if ((fp = fopen(name, "w")) == NULL)
+        unix_error("Could not open %s in write_trace", name);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, fp) !=
+        (size_t)trace->num_ops || fclose(fp) != 0)
+        unix_error("Could not write %s in write_trace", name);
+    printf("Wrote %s\n", name);
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -846,13 +1366,18 @@ static void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-    int i;
-    int index;
+    int i, j;
+    int index, arena;
     size_t size;
     char *newp;
     char *oldp;
     char *p;
 
+    if (trace->num_arenas > 0 && mm_arena_create == NULL) {
+        malloc_error(trace, 0, "the allocator has no region arenas.");
+        return 0;
+    }
+
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
     clear_ranges(ranges);
@@ -868,24 +1393,23 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     for (i = 0;  i < trace->num_ops;  i++) {
         index = trace->ops[i].index;
         size = trace->ops[i].size;
+        arena = trace->ops[i].arena;
 
         if(debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
-                        
             /* Let the students check their own heap */
             mm_checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
-            r = *ranges;
-            while(r) {
-                check_index(trace, i, r->index);
-                r = r->next;
-            }
+            if (!trace->ignore_ranges)
+                check_ranges(*ranges, trace, i);
         }
+        if (incr_check)
+            mm_checkheap_incr(verbose);
 
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+            arena_error(trace, i, index);
 
             /* Call the student's malloc */
             if ((p = mm_malloc(size)) == NULL) {
@@ -910,6 +1434,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             break;
 
         case REALLOC: /* mm_realloc */
+            arena_error(trace, i, index);
             check_index(trace, i, index);
 
             /* Call the student's realloc */
@@ -950,6 +1475,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             break;
 
         case FREE: /* mm_free */
+            arena_error(trace, i, index);
             check_index(trace, i, index);
 
             /* Remove region from list and call student's free function */
@@ -962,6 +1488,46 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             mm_free(p);
             break;
 
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            arena_error(trace, i, index);
+            if (trace->arenas[arena] == NULL &&
+                (trace->arenas[arena] = mm_arena_create(0)) == NULL) {
+                malloc_error(trace, i, "mm_arena_create failed.");
+                return 0;
+            }
+            if ((p = mm_arena_alloc(trace->arenas[arena], size)) == NULL) {
+                malloc_error(trace, i, "mm_arena_alloc failed.");
+                return 0;
+            }
+            if (add_range(ranges, p, size, trace, i, index) == 0)
+                return 0;
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            arena_push(trace, arena, index);
+            randomize_block(trace, index);
+            break;
+
+        case ARENA_RESET: /* mm_arena_reset */
+        case ARENA_DESTROY: /* mm_arena_destroy */
+
+            /* The blocks of the arena must be intact until then */
+            for (j = trace->arena_first[arena]; j >= 0;
+                 j = trace->block_next[j]) {
+                check_index(trace, i, j);
+                remove_range(ranges, trace->blocks[j]);
+                trace->block_arena[j] = -1;
+            }
+            trace->arena_first[arena] = -1;
+            if (trace->arenas[arena] == NULL)
+                break;
+            if (trace->ops[i].type == ARENA_RESET) {
+                mm_arena_reset(trace->arenas[arena]);
+            } else {
+                mm_arena_destroy(trace->arenas[arena]);
+                trace->arenas[arena] = NULL;
+            }
+            break;
+
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -978,16 +1544,15 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
  *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   package on the trace. mem_sbrk() may shrink the heap, so the
+ *   high water mark of brk (mem_peaksize) is taken.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
-    int i;
-    int index;
+    int i, j;
+    int index, arena;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
@@ -1053,11 +1618,55 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             total_size -= size;
             break;
 
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            arena = trace->ops[i].arena;
+
+            if ((trace->arenas[arena] == NULL &&
+                 (trace->arenas[arena] = mm_arena_create(0)) == NULL) ||
+                (p = mm_arena_alloc(trace->arenas[arena], size)) == NULL)
+                app_error("trace %d: mm_arena_alloc failed in eval_mm_util",
+                          tracenum);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            arena_push(trace, arena, index);
+
+            total_size += size;
+            break;
+
+        case ARENA_RESET: /* mm_arena_reset */
+        case ARENA_DESTROY: /* mm_arena_destroy */
+            arena = trace->ops[i].arena;
+            for (j = trace->arena_first[arena]; j >= 0;
+                 j = trace->block_next[j])
+                total_size -= trace->block_sizes[j];
+            trace->arena_first[arena] = -1;
+            if (trace->arenas[arena] == NULL)
+                break;
+            if (trace->ops[i].type == ARENA_RESET) {
+                mm_arena_reset(trace->arenas[arena]);
+            } else {
+                mm_arena_destroy(trace->arenas[arena]);
+                trace->arenas[arena] = NULL;
+            }
+            break;
+
         default:
             app_error("trace %d: Nonexistent request type in eval_mm_util",
                       tracenum);
         }
 
+#ifdef MM_STATS
+        if (total_size > max_total_size)
+            peak_op = i;
+        if (i == stats_op)
+            mm_stats(&peak_stats);
+        if (map_fp != NULL && (i % map_ops == 0 || i == trace->num_ops - 1)) {
+            fprintf(map_fp, "op %d %d\n", i, total_size);
+            mm_heapmap(map_fp);
+        }
+#endif
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
@@ -1065,7 +1674,8 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* The heap may have shrunk since its peak */
+    return ((double)max_total_size / (double)mem_peaksize());
 }
 
 
@@ -1075,7 +1685,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index, size, newsize, arena;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
@@ -1116,11 +1726,179 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            index = trace->ops[i].index;
+            arena = trace->ops[i].arena;
+            if ((trace->arenas[arena] == NULL &&
+                 (trace->arenas[arena] = mm_arena_create(0)) == NULL) ||
+                (p = mm_arena_alloc(trace->arenas[arena],
+                                    trace->ops[i].size)) == NULL)
+                app_error("mm_arena_alloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case ARENA_RESET: /* mm_arena_reset */
+            if (trace->arenas[trace->ops[i].arena] != NULL)
+                mm_arena_reset(trace->arenas[trace->ops[i].arena]);
+            break;
+
+        case ARENA_DESTROY: /* mm_arena_destroy */
+            mm_arena_destroy(trace->arenas[trace->ops[i].arena]);
+            trace->arenas[trace->ops[i].arena] = NULL;
+            break;
+
         default:
             app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
+/*
+ * eval_mm_latency - Runs the trace once more, reading the cycle counter
+ *   around every request, and prints the p50, p99, p99.9 and largest
+ *   number of cycles of each kind of request, then the slowest requests.
+ *   The overhead of the counter is taken off; a request hit by a timer
+ *   interrupt or a page fault shows up as a spike too.
+ */
+static void eval_mm_latency(trace_t *trace)
+{
+    static const char *names[] = { "malloc", "free", "realloc",
+                                   "bump", "reset", "destroy" };
+    double *cycles, *sorted, overhead, c;
+    int *worst;
+    int i, j, n, type, index, size;
+    mm_arena_t **arena;
+    char *p, *block;
+
+    if ((cycles = malloc(trace->num_ops * sizeof(double))) == NULL ||
+        (sorted = malloc(trace->num_ops * sizeof(double))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+    overhead = ovhd();
+    reinit_trace(trace);
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        arena = &trace->arenas[trace->ops[i].arena];
+        switch (trace->ops[i].type) {
+
+        case ALLOC:
+            start_counter();
+            p = mm_malloc(size);
+            c = get_counter();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC:
+            start_counter();
+            p = mm_realloc(trace->blocks[index], size);
+            c = get_counter();
+            if (p == NULL && size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE:
+            block = index < 0 ? NULL : trace->blocks[index];
+            start_counter();
+            mm_free(block);
+            c = get_counter();
+            break;
+
+        case ARENA_ALLOC:
+            start_counter();
+            if (*arena == NULL)
+                *arena = mm_arena_create(0);
+            p = *arena != NULL ? mm_arena_alloc(*arena, size) : NULL;
+            c = get_counter();
+            if (p == NULL)
+                app_error("mm_arena_alloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case ARENA_RESET:
+            start_counter();
+            if (*arena != NULL)
+                mm_arena_reset(*arena);
+            c = get_counter();
+            break;
+
+        case ARENA_DESTROY:
+            start_counter();
+            mm_arena_destroy(*arena);
+            c = get_counter();
+            *arena = NULL;
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+        cycles[i] = c > overhead ? c - overhead : 0;
+    }
+
+    printf("\nLatency in cycles for %s\n", trace->filename);
+    printf("  %-8s %9s %9s %9s %9s %11s\n", "request", "count", "p50",
+           "p99", "p99.9", "max");
+    for (type = 0; type <= NUM_TYPES; type++) {
+        n = 0;
+        for (i = 0; i < trace->num_ops; i++)
+            if (type == NUM_TYPES || (int)trace->ops[i].type == type)
+                sorted[n++] = cycles[i];
+        if (n == 0)
+            continue;
+        qsort(sorted, n, sizeof(double), cmp_cycles);
+        printf("  %-8s %9d %9.0f %9.0f %9.0f %11.0f\n",
+               type == NUM_TYPES ? "all" : names[type], n,
+               sorted[(n - 1) / 2],
+               sorted[(int)(0.99 * (n - 1))],
+               sorted[(int)(0.999 * (n - 1))], sorted[n - 1]);
+    }
+
+    /* Insertion of each request in the LAT_WORST slowest so far */
+    if ((worst = malloc(LAT_WORST * sizeof(int))) == NULL)
+        unix_error("malloc failed in eval_mm_latency");
+    for (n = i = 0; i < trace->num_ops; i++) {
+        if (n == LAT_WORST && cycles[i] <= cycles[worst[n - 1]])
+            continue;
+        for (j = n < LAT_WORST ? n++ : n - 1;
+             j > 0 && cycles[worst[j - 1]] < cycles[i]; j--)
+            worst[j] = worst[j - 1];
+        worst[j] = i;
+    }
+    printf("  slowest requests:\n");
+    for (j = 0; j < n; j++) {
+        i = worst[j];
+        printf("  %11.0f  op %d (line %d): %s", cycles[i], i, LINENUM(i),
+               names[trace->ops[i].type]);
+        if (trace->ops[i].type >= ARENA_ALLOC)
+            printf(" arena %d", trace->ops[i].arena);
+        if (trace->ops[i].type <= ARENA_ALLOC)
+            printf(" id %d", trace->ops[i].index);
+        if (trace->ops[i].type != FREE && trace->ops[i].type <= ARENA_ALLOC)
+            printf(" size %lu", (unsigned long)trace->ops[i].size);
+        printf("\n");
+    }
+
+    free(worst);
+    free(sorted);
+    free(cycles);
+}
+
+/*
+ * cmp_cycles - qsort order of the latencies
+ */
+static int cmp_cycles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1129,7 +1907,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     reinit_trace(trace);
@@ -1163,6 +1941,23 @@ static int eval_libc_valid(trace_t *trace)
             }
             break;
 
+        case ARENA_ALLOC: /* malloc, freed with the arena */
+            if ((p = malloc(trace->ops[i].size)) == NULL) {
+                malloc_error(trace, i, "libc malloc failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            arena_push(trace, trace->ops[i].arena, trace->ops[i].index);
+            break;
+
+        case ARENA_RESET: /* free of every block of the arena */
+        case ARENA_DESTROY:
+            for (j = trace->arena_first[trace->ops[i].arena]; j >= 0;
+                 j = trace->block_next[j])
+                free(trace->blocks[j]);
+            trace->arena_first[trace->ops[i].arena] = -1;
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1178,7 +1973,7 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -1214,15 +2009,131 @@ static void eval_libc_speed(void *ptr)
                 free(0);
             }
             break;
+
+        case ARENA_ALLOC: /* malloc, freed with the arena */
+            index = trace->ops[i].index;
+            if ((p = malloc(trace->ops[i].size)) == NULL)
+                unix_error("malloc failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            arena_push(trace, trace->ops[i].arena, index);
+            break;
+
+        case ARENA_RESET: /* free of every block of the arena */
+        case ARENA_DESTROY:
+            for (j = trace->arena_first[trace->ops[i].arena]; j >= 0;
+                 j = trace->block_next[j])
+                free(trace->blocks[j]);
+            trace->arena_first[trace->ops[i].arena] = -1;
+            break;
         }
     }
 }
 
+#ifdef MM_STATS
+/*
+ * eval_mm_stats - Runs the trace once more through eval_mm_util to get 
+ *   the mm_stats of the heap at its high water mark, and prints them with
+ *   the counters of the whole run.
+ */
+static void eval_mm_stats(trace_t *trace, int tracenum)
+{
+    mm_stats_t all;
+    unsigned long allocs, frees;
+    int i;
+
+    stats_op = peak_op;
+    eval_mm_util(trace, tracenum);
+    stats_op = -1;
+    mm_stats(&all);
+
+    printf("\nmm_stats for %s\n", trace->filename);
+    printf("  internal fragmentation %5.1f%% (%lu payload bytes in %lu)\n",
+           all.allocated ? 100.0 * (all.allocated - all.requested) /
+           all.allocated : 0.0,
+           (unsigned long)all.requested, (unsigned long)all.allocated);
+    printf("  at the peak (op %d) : heap %lu, %lu free in %lu blocks, "
+           "largest %lu\n", peak_op, (unsigned long)peak_stats.heap,
+           (unsigned long)peak_stats.free_bytes, peak_stats.free_blocks,
+           (unsigned long)peak_stats.largest_free);
+    printf("  external fragmentation %5.1f%% (free bytes not in the "
+           "largest free block)\n", peak_stats.free_bytes ?
+           100.0 * (peak_stats.free_bytes - peak_stats.largest_free) /
+           peak_stats.free_bytes : 0.0);
+    printf("  find_fit : %lu searches, %.2f list probes each, %lu misses, "
+           "%lu tree searches\n", all.fit_searches, all.fit_searches ?
+           (double)all.fit_probes / all.fit_searches : 0.0,
+           all.fit_misses, all.tree_fits);
+    printf("  %lu splits, %lu coalesces, %lu extensions (%lu bytes), "
+           "%lu trims\n", all.splits, all.coalesces, all.extends,
+           (unsigned long)all.extend_bytes, all.trims);
+    printf("  quick lists : %lu frees, %lu reused, %lu drains\n",
+           all.quick_frees, all.quick_allocs, all.quick_drains);
+    printf("  %-10s %10s %10s\n", "class", "allocs", "frees");
+    for (i = 0; i < MM_STATS_CLASSES; i++) {
+        if (all.allocs[i] || all.frees[i])
+            printf("  bucket %-3d %10lu %10lu\n", i, all.allocs[i],
+                   all.frees[i]);
+    }
+    for (i = 0; i < MM_STATS_CLASSES; i++) {
+        if (all.slab_allocs[i] || all.slab_frees[i])
+            printf("  slab %-5d %10lu %10lu\n", i, all.slab_allocs[i],
+                   all.slab_frees[i]);
+    }
+    allocs = frees = 0;
+    for (i = 0; i < MM_STATS_CLASSES; i++) {
+        allocs += all.allocs[i] + all.slab_allocs[i];
+        frees += all.frees[i] + all.slab_frees[i];
+    }
+    printf("  %-10s %10lu %10lu\n", "total", allocs, frees);
+}
+
+/*
+ * eval_mm_heapmap - Runs the trace once more through eval_mm_util, which
+ *   writes the mm_heapmap of the heap every map_ops ops and after the
+ *   last one to name.map in the current directory, each map after an 
+ *   "op opnum payload_bytes" line.
+ */
+static void eval_mm_heapmap(trace_t *trace, int tracenum)
+{
+    char name[MAXLINE];
+    const char *base = strrchr(trace->filename, '/');
+    size_t len;
+
+    base = base != NULL ? base + 1 : trace->filename;
+    strcpy(name, base);
+    len = strlen(name);
+    if (len >= 4 && strcmp(name + len - 4, ".rep") == 0)
+        name[len - 4] = '\0';
+    strcat(name, ".map");
+
+    if ((map_fp = fopen(name, "w")) == NULL)
+        unix_error("Could not open %s in eval_mm_heapmap", name);
+    eval_mm_util(trace, tracenum);
+    if (fclose(map_fp) != 0)
+        unix_error("Could not write %s in eval_mm_heapmap", name);
+    map_fp = NULL;
+    if (verbose > 1)
+        printf("\nHeap map of %s written to %s\n", trace->filename, name);
+}
+#endif
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
+/*
+ * arena_error - Stops on a trace which frees or reallocates block index of
+ *     a region arena
+ */
+static void arena_error(const trace_t *trace, int opnum, int index)
+{
+    if (index >= 0 && trace->block_arena[index] >= 0)
+        app_error("%s: request %d (line %d) on block %d of region arena %d",
+                  trace->filename, opnum, LINENUM(opnum), index,
+                  trace->block_arena[index]);
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -1239,8 +2150,9 @@ static void printresults(int n, stats_t *stats)
     char wstr;
 
     /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    printf("  %2s%6s %5s%8s%9s %7s%7s  %s\n",
+           "valid", "util", "ops", "secs", "Kops", "heapKB", "rssKB",
+           "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1282,6 +2194,13 @@ static void printresults(int n, stats_t *stats)
             else
                 printf("%8s%10s%6s", "--", "--", "--");
 
+            /* heap and resident heap at the end of the trace (mm only) */
+            if (stats[i].heap > 0)
+                printf("%8.0f%7.0f", stats[i].heap / 1024,
+                       stats[i].rss / 1024);
+            else
+                printf("%8s%7s", "--", "--");
+
             printf(" %s\n", stats[i].filename);
 
             if(stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1297,13 +2216,15 @@ static void printresults(int n, stats_t *stats)
                 }
         }
         else {
-            printf("%2s%4s %6s%8s%10s%6s %s\n",
+            printf("%2s%4s %6s%8s%10s%6s%8s%7s %s\n",
                    stats[i].weight != 0 ? "*" : "",
                    "no",
                    "-",
                    "-",
                    "-",
                    "-",
+                   "-",
+                   "-",
                    stats[i].filename);
         }
     }
@@ -1375,14 +2296,26 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlLVdDBC] [-f <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
+    fprintf(stderr, "\t-C         Check the blocks changed by each request\n"
+            "\t           (mm_checkheap_incr), cheap enough for long runs.\n");
     fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
+    fprintf(stderr, "\t-B         Write each trace as a binary trace (.bin), which is\n"
+            "\t           then mapped instead of parsing the .rep file.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate n traces at once in processes of their own\n"
+            "\t           (0 or more than the cpus : one per cpu).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+#ifdef MM_STATS
+    fprintf(stderr, "\t-M <n>     Write the heap map every n ops to name.map\n"
+            "\t           (see mmheapmap).\n");
+#endif
+    fprintf(stderr, "\t-L         Time each request and print the percentiles of\n"
+            "\t           their cycles and the slowest ones.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
@@ -20,6 +20,7 @@
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static char *mem_peak_brk;      /* highest brk since the last reset */
 
 /* 
  * mem_init - initialize the memory system model
@@ -34,6 +35,7 @@ void mem_init(void){
 			0);						/* offset (dunno) */
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_peak_brk = heap;
 }
 
 /* 
@@ -48,28 +50,72 @@ void mem_deinit(void){
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	mem_peak_brk = heap;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap and gives its pages back.
  */
 void *mem_sbrk(int incr) {
 	char *old_brk = mem_brk;
 
+	if ((mem_brk + incr) < heap) {
+		errno = EINVAL;
+		fprintf(stderr, "ERROR: mem_sbrk failed. Heap shrunk below its start\n");
+		return (void *)-1;
+	}
+
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
+    // Only to grow : the process break may have moved on since (libc malloc
+    // of the driver), moving it back would cut into that memory.
+	if ( ((mem_brk + incr) > mem_max_addr) ||
+            (incr > 0 && sbrk(incr) == (void *) -1)) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
 
 	mem_brk += incr;
+	if (incr < 0)
+		mem_release(mem_brk, -incr);
+	if (mem_brk > mem_peak_brk)
+		mem_peak_brk = mem_brk;
 	return (void *)old_brk;
 }
 
+/*
+ * mem_release - gives the whole pages in [addr, addr + len) back to the
+ *		system, they read as zero when touched again
+ */
+void mem_release(void *addr, size_t len){
+	size_t page = mem_pagesize();
+	char *lo = (char *)(((size_t)addr + page - 1) & ~(page - 1));
+	char *hi = (char *)(((size_t)addr + len) & ~(page - 1));
+
+	if (lo < hi)
+		madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_rss - returns the bytes of the heap model resident in memory
+ */
+size_t mem_rss(){
+	size_t page = mem_pagesize();
+	size_t pages = MAX_HEAP / page, i, j, n, rss = 0;
+	unsigned char vec[4096];
+
+	for (i = 0; i < pages; i += n) {
+		n = pages - i < sizeof(vec) ? pages - i : sizeof(vec);
+		if (mincore(heap + i * page, n * page, vec) == -1)
+			return 0;
+		for (j = 0; j < n; j++)
+			rss += (vec[j] & 1) * page;
+	}
+	return rss;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -91,6 +137,14 @@ size_t mem_heapsize() {
 	return (size_t)((void *)mem_brk - (void *)heap);
 }
 
+/*
+ * mem_peaksize() - returns the largest heap size in bytes since the last 
+ *		mem_init or mem_reset_brk
+ */
+size_t mem_peaksize() {
+	return (size_t)((void *)mem_peak_brk - (void *)heap);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
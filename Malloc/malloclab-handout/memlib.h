@@ -7,5 +7,8 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peaksize(void);
 size_t mem_pagesize(void);
+void mem_release(void *addr, size_t len);
+size_t mem_rss(void);
 
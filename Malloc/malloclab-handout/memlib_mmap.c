@@ -0,0 +1,165 @@
+/*
+ * memlib_mmap.c - the memory system of libmm.so. Same interface as
+ *		memlib.c, but backed by real memory so that the allocator can be
+ *		preloaded into real programs : mem_init reserves MAX_HEAP bytes
+ *		of address space without any access, and mem_sbrk commits the
+ *		pages it hands out (read/write access). The reservation is
+ *		MAP_NORESERVE, so committed pages only cost memory once touched,
+ *		and pages given back (shrinking brk, mem_release) stay committed
+ *		but are dropped from memory.
+ *
+ *		Nothing here may call malloc (this is the malloc of the program),
+ *		so errors are only reported through errno.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <errno.h>
+
+#include "memlib.h"
+#include "config.h"
+
+/* private variables */
+static char *heap;
+static char *mem_brk;
+static char *mem_commit;	/* end of the read/write pages */
+static char *mem_max_addr;
+static char *mem_peak_brk;	/* highest brk since the last reset */
+
+/*
+ * mem_init - reserve the address space of the heap
+ */
+void mem_init(void){
+	heap = mmap(NULL, MAX_HEAP, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (heap == MAP_FAILED) {
+		heap = NULL;
+		return;
+	}
+	mem_max_addr = heap + MAX_HEAP;
+	mem_brk = mem_commit = heap;	/* heap is empty initially */
+	mem_peak_brk = heap;
+}
+
+/*
+ * mem_deinit - give the address space back
+ */
+void mem_deinit(void){
+	if (heap != NULL)
+		munmap(heap, MAX_HEAP);
+	heap = NULL;
+}
+
+/*
+ * mem_reset_brk - reset the brk pointer to make an empty heap, the pages
+ *		stay committed
+ */
+void mem_reset_brk(){
+	mem_brk = heap;
+	mem_peak_brk = heap;
+}
+
+/*
+ * mem_sbrk - extends the heap by incr bytes and returns the start address
+ *		of the new area, committing whole pages as the brk crosses them.
+ *		A negative incr shrinks the heap and gives its pages back.
+ */
+void *mem_sbrk(int incr) {
+	char *old_brk = mem_brk;
+	char *end;
+
+	if (heap == NULL || (incr > mem_max_addr - mem_brk) ||
+			(incr < heap - mem_brk)) {
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	if (incr < 0) {
+		mem_brk += incr;
+		mem_release(mem_brk, -incr);
+		return (void *)old_brk;
+	}
+
+	end = mem_brk + incr;
+	if (end > mem_commit) {
+		size_t page = mem_pagesize();
+		char *commit = heap + ((end - heap + page - 1) & ~(page - 1));
+
+		if (mprotect(mem_commit, commit - mem_commit,
+					PROT_READ | PROT_WRITE) == -1)
+			return (void *)-1;
+		mem_commit = commit;
+	}
+
+	mem_brk = end;
+	if (mem_brk > mem_peak_brk)
+		mem_peak_brk = mem_brk;
+	return (void *)old_brk;
+}
+
+/*
+ * mem_release - gives the whole pages in [addr, addr + len) back to the
+ *		system, they read as zero when touched again
+ */
+void mem_release(void *addr, size_t len){
+	size_t page = mem_pagesize();
+	char *lo = (char *)(((size_t)addr + page - 1) & ~(page - 1));
+	char *hi = (char *)(((size_t)addr + len) & ~(page - 1));
+
+	if (lo < hi)
+		madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo(){
+	return (void *)heap;
+}
+
+/*
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi(){
+	return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize() {
+	return (size_t)(mem_brk - heap);
+}
+
+/*
+ * mem_peaksize() - returns the largest heap size in bytes since the last
+ *		mem_init or mem_reset_brk
+ */
+size_t mem_peaksize() {
+	return (size_t)(mem_peak_brk - heap);
+}
+
+/*
+ * mem_rss - returns the bytes of the committed heap resident in memory
+ */
+size_t mem_rss(){
+	size_t page = mem_pagesize();
+	size_t pages = (mem_commit - heap) / page, i, j, n, rss = 0;
+	unsigned char vec[4096];
+
+	for (i = 0; i < pages; i += n) {
+		n = pages - i < sizeof(vec) ? pages - i : sizeof(vec);
+		if (mincore(heap + i * page, n * page, vec) == -1)
+			return 0;
+		for (j = 0; j < n; j++)
+			rss += (vec[j] & 1) * page;
+	}
+	return rss;
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize(){
+	return (size_t)getpagesize();
+}
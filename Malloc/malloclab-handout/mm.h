@@ -1,3 +1,6 @@
+#ifndef MM_H
+#define MM_H
+
 #include <stdio.h>
 
 #ifdef DRIVER
@@ -15,6 +18,11 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern void *valloc(size_t size);
+extern size_t malloc_usable_size(void *ptr);
 
 #endif
 
@@ -22,3 +30,74 @@ extern int mm_init(void);
 
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
+
+/* 
+ * mm_checkheap_incr : checks only the blocks changed since its last call 
+ * (and one free list), cheap enough to run after every request
+ */
+extern void mm_checkheap_incr(int verbose);
+
+/* 
+ * Region arenas : blocks bumped out of chunks of the heap, all dropped at
+ * once by mm_arena_reset (the chunks are kept) or mm_arena_destroy. The 
+ * blocks must not be given to free or realloc. An arena is not locked, 
+ * only one thread at a time may use it
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(size_t chunk_size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+#ifdef MM_STATS
+
+/* 
+ * Allocator counters (mm.c built with MM_STATS), counted from mm_init on.
+ * Blocks are counted by the seggregated list bucket of their size and 
+ * slab slots by their class. With threads, slots served by the thread 
+ * caches are not counted
+ */
+#define MM_STATS_CLASSES 64
+
+typedef struct {
+    unsigned long allocs[MM_STATS_CLASSES];      /* blocks placed */
+    unsigned long frees[MM_STATS_CLASSES];       /* blocks coalesced (with
+                                                    realloc tails, runs and
+                                                    quick blocks drained) */
+    unsigned long slab_allocs[MM_STATS_CLASSES]; /* slots given */
+    unsigned long slab_frees[MM_STATS_CLASSES];  /* slots given back */
+    unsigned long splits;       /* free remainders split off a block */
+    unsigned long coalesces;    /* free neighbours merged */
+    unsigned long fit_searches; /* find_fit calls */
+    unsigned long fit_probes;   /* list blocks looked at by find_fit */
+    unsigned long fit_misses;   /* find_fit calls which found nothing */
+    unsigned long tree_fits;    /* best fit searches of the tree */
+    unsigned long extends;      /* heap extensions */
+    size_t extend_bytes;        /* bytes added by them */
+    unsigned long trims;        /* heap trims */
+    unsigned long quick_frees;  /* blocks put on the quick lists */
+    unsigned long quick_allocs; /* blocks taken back from them */
+    unsigned long quick_drains; /* times the quick lists were coalesced */
+    size_t requested;           /* payload bytes asked by malloc */
+    size_t allocated;           /* block or slot bytes given for them */
+
+    /* From a walk of the heap by mm_stats */
+    size_t heap;                /* heap bytes */
+    size_t free_bytes;          /* bytes in free blocks */
+    size_t largest_free;        /* largest free block */
+    unsigned long free_blocks;  /* number of free blocks */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/* 
+ * Writes the blocks of the heap to fp, one per line : 
+ * "offset size a|f class" or "offset size s class used slots" for a slab
+ * run, after an "arena index heapsize" line per arena
+ */
+extern void mm_heapmap(FILE *fp);
+
+#endif
+
+#endif
@@ -5,10 +5,32 @@
  *
  *  Malloc : Allocates a memory chunk on the heap as requested by user.
  *  It takes in as size from the user and finds the chunksize in seggregated
- *  lists till it matches the first chunk. Seggregated lists has chunks are 
- *  which are of different sizes such as first list contains chunks of size 
- *  200, second 400 and etc and total number of buckets are 12. Minimum chunk
- *  size that can be allocated is 16 bytes 
+ *  lists till it matches the first chunk. Seggregated lists are size 
+ *  classes : one class per 8 bytes below 64 bytes and four classes per
+ *  power of two above it up to 4096 bytes, then a tree for larger blocks
+ *  (33 buckets in total), or the classes derived from traces by mmclasses
+ *  in mm_classes.h when built with MM_CLASSES. A bitmap
+ *  of non-empty buckets finds the first bucket large enough with one bit 
+ *  scan. Minimum chunk size that can be allocated is 16 bytes (12 bytes of
+ *  payload)
+ *
+ *  Only free blocks have a footer : bit 1 of every header (PREV_ALLOC) 
+ *  tells whether the previous block is allocated, so PREV_BLKP (which 
+ *  reads the previous footer) is only used when that bit is clear. 
+ *  Allocated blocks are a header followed by the payload.
+ *
+ *  Requests up to SLAB_MAX bytes are served by slabs instead : runs 
+ *  (allocated blocks of RUN_SIZE bytes with payload aligned to RUN_SIZE)
+ *  split into equal slots of one size class, with a bitmap of used slots 
+ *  in the run header and no header/footer per object. A bitmap over the 
+ *  heap (slab_map) tells whether a pointer lies in a run. A class only 
+ *  gets runs after SLAB_DEMAND requests, before that it uses the lists.
+ *
+ *  Quick lists : freed blocks of up to QUICK_MAX bytes are not coalesced 
+ *  right away. They stay marked allocated on a list per block size, from 
+ *  which malloc of that size takes them back without splitting, and are 
+ *  only freed and coalesced as a batch once the lists hold QUICK_BYTES, or
+ *  before the heap is extended.
  *
  * Parameter : size (size of block requested)
  * Output : pointer to the the block
@@ -31,16 +53,66 @@
  *  Calloc :  allocates block of array with n elements of size m each with zero
  *
  *  Parameter : memb (number of elements), size (size of each element)
+ *
+ *  Arenas : all the state above (list heads, bucket map, slab runs) lives
+ *  in an arena, a heap of its own, and every internal routine works on the
+ *  arena it is given. By default there is one arena growing with mem_sbrk.
+ *  Built with MM_THREADS the memlib heap is split in MM_ARENAS spans, one 
+ *  per arena, each with a lock; threads are spread over the arenas round 
+ *  robin. A block freed by a thread of another arena is pushed on a lock 
+ *  free stack of its arena (found from the address), which the arena 
+ *  drains the next time it is locked, and each thread caches up to 
+ *  TCACHE_MAX freed slab slots per class which malloc reuses without any
+ *  lock. mm_init must be called before the threads start.
+ *
+ *  Without DRIVER this file is the malloc of real programs (libmm.so, 
+ *  preloaded with memlib_mmap.c) : mm_init runs on the first call, once,
+ *  and also provides memalign, posix_memalign, aligned_alloc, valloc and
+ *  malloc_usable_size. With threads all arenas are locked around fork so
+ *  that the child gets consistent heaps. Requests of MMAP_THRESHOLD bytes
+ *  or more are mapped directly there and unmapped by free, so that a few 
+ *  huge blocks do not pin the heap.
+ *
+ *  Region arenas : mm_arena_create gives an arena (not one of the heap 
+ *  arenas above) from which mm_arena_alloc bumps a pointer through chunks 
+ *  of the heap, taken with malloc. Its blocks are never freed one by one :
+ *  mm_arena_reset drops them all at once and keeps the chunks for the next
+ *  allocations, mm_arena_destroy gives the chunks back to free.
+ *
+ *  Incremental checks : once mm_checkheap_incr has been called, every 
+ *  block the arena changes is recorded in a small dirty set (blocks which 
+ *  disappear in a merge are dropped from it). The next call checks only 
+ *  those blocks against their neighbours and lists, plus one seggregated
+ *  list in turn, and falls back on the full mm_checkheap when the set 
+ *  overflowed, so that checks can stay on over long runs on large heaps.
+ *
+ *  64-bit mode : built with MM_64, headers, footers and list offsets are 
+ *  8 byte words (32 byte minimum block) and payloads are 16 byte aligned.
+ *  The heap is then only limited by MAX_HEAP instead of the 4 GB of 32-bit
+ *  offsets.
  * 
  */
+#ifndef DRIVER
+#define _GNU_SOURCE         /* mremap */
+#endif
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+#ifndef DRIVER
+#include <sys/mman.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#ifdef MM_THREADS
+#include "config.h"
+#endif
 
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
@@ -62,418 +134,1200 @@
 #define calloc mm_calloc
 #endif /* def DRIVER */
 
-/* single word (4) or double word (8) alignment */
+/* double word alignment : 8 bytes, 16 in 64-bit mode */
+#ifdef MM_64
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
-
-/* Header files for I/O, string manipulation */
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-/* Header file for for memory functions such as mem_sbrk etc*/
-#include "mm.h"
-#include "memlib.h"
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /* $begin mallocmacros */
 /* Basic constants and macros */
+#ifdef MM_64
+typedef size_t word_t;      /* header/footer and list offset word */
+#define WSIZE       8       /* Word and header/footer size (bytes) */
+#define DSIZE       16      /* Doubleword size (bytes) */
+#else
+typedef unsigned int word_t;
 #define WSIZE       4       /* Word and header/footer size (bytes) */ 
 #define DSIZE       8       /* Doubleword size (bytes) */
+#endif
 #define CHUNKSIZE   256 /* Extend heap by this amount (bytes) */
 #define NEXT 1  /*Refers to the next element */
 #define PREV 0  /*Refers to the previous element */
 #define CURR 2  /*Refers to the current element */
-#define BUCKET 12/*Refers to the bucket size always a multiple of 2*/
 
 /*
- * Bucket size range for 12 Buckets 
- * such as Bucket1 has a range from 0 -200
- * Bucket2 (range 201 - 400) etc
+ * Size classes for 33 Buckets 
+ * Sizes below LINEAR_MAX get one bucket per DSIZE (bucket = size / 8),
+ * larger sizes get SUBCLASS buckets per power of two, e.g. 64-79, 80-95, 
+ * 96-111, 112-127, 128-159 etc. up to 4095. Last bucket holds everything 
+ * larger and is a best fit tree rather than a list.
  */
 
-
-#define BUCKET1 200
-#define BUCKET2 400
-#define BUCKET3 800
-#define BUCKET4 1000
-#define BUCKET5 2500
-#define BUCKET6 5000
-#define BUCKET7 12000
-#define BUCKET8 24000
-#define BUCKET9 30000
-#define BUCKET10 40000
-#define BUCKET11 50000
-#define BUCKET12 60000
+#define LINEAR_MAX 64   /* sizes below this are one bucket per 8 bytes */
+#define LINEAR_BITS 6   /* log2(LINEAR_MAX) */
+#define SUBCLASS_BITS 2 /* log2 of buckets per power of two */
+#define TREE_BITS 12    /* log2 of the smallest block kept in the tree */
+#define LAST_BUCKET ((LINEAR_MAX >> 3) + ((TREE_BITS - LINEAR_BITS) << \
+        SUBCLASS_BITS))
+#define BUCKET (LAST_BUCKET + 1) /*Refers to the number of buckets */
 
 /* 
- * Bucket Indexs to identify the seggregated list 
- * Index are set by findList funtion and used in bucket_ptr
- * which identifies the seggregated list
+ * Bucket index of a block size : count leading zeros gives the power of 
+ * two and the next SUBCLASS_BITS bits below it give the subdivision
  */
 
+#define MSB(size) (63 - __builtin_clzll(size))
+#ifndef MM_CLASSES
+#define BUCKET_INDEX(size) ((size) < LINEAR_MAX ? (unsigned int)(size) >> 3 :\
+        MIN((unsigned int)(LINEAR_MAX >> 3) + ((MSB(size) - LINEAR_BITS) << \
+        SUBCLASS_BITS) + (((size) >> (MSB(size) - SUBCLASS_BITS)) & \
+        ((1 << SUBCLASS_BITS) - 1)), LAST_BUCKET))
+#else
+
+/* 
+ * Built with MM_CLASSES the buckets below the tree are those of the
+ * generated mm_classes.h (mmclasses, from the request sizes of traces) :
+ * CLASS_LISTS lists and a table of the bucket of each size / 8
+ */
 
-#define BINDEX1 0
-#define BINDEX2 1
-#define BINDEX3 2
-#define BINDEX4 3
-#define BINDEX5 4
-#define BINDEX6 5
-#define BINDEX7 6
-#define BINDEX8 7
-#define BINDEX9 8
-#define BINDEX10 9
-#define BINDEX11 10
-#define BINDEX12 11
+#include "mm_classes.h"
+#undef LAST_BUCKET
+#define LAST_BUCKET CLASS_LISTS
+#define BUCKET_INDEX(size) ((size) < CLASS_TREE_MIN ? \
+        (unsigned int)class_index[(size) >> 3] : LAST_BUCKET)
+_Static_assert(CLASS_LISTS < 64 && CLASS_TREE_MIN >= 256,
+		"mm_classes.h : at most 63 lists, a tree from 256 bytes on");
+#endif
 
 /* MAX macro gives maximum of two values x & y */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
 
+/* MIN macro gives minimum of two values x & y */
+
+#define MIN(x, y) ((x) < (y)? (x) : (y))  
+
+/* Adjusted block size of a request : payload plus header, aligned */
+#define ASIZE(size) MAX(2*DSIZE, DSIZE * (((size) + WSIZE + (DSIZE-1)) / \
+			DSIZE))
+
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) 
 
+/* Header bit set when the previous block is allocated */
+#define PREV_ALLOC 0x2
+
 /* Read and write a word at address p */
-#define GET(p)       (*(unsigned int *)(p))        
-#define PUT(p, val)  (*(unsigned int *)(p) = (val)) 
+#define GET(p)       (*(word_t *)(p))
+#define PUT(p, val)  (*(word_t *)(p) = (val)) 
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)                  
 #define GET_ALLOC(p) (GET(p) & 0x1)                  
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Set and clear the previous block allocated bit of header p */
+#define SET_PREV_ALLOC(p)   PUT(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Given block ptr bp, compute address of its header and footer (free 
+ * blocks only) */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks 
+ * (previous block must be free) */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE))) 
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* 
+ * Slab constants : requests up to SLAB_MAX bytes are rounded up to a 
+ * multiple of DSIZE and served from a run of their class 
+ */
+
+#define SLAB_MAX      128  /* largest request served from slabs */
+#define SLAB_CLASSES  (SLAB_MAX / DSIZE) /* one class per DSIZE bytes */
+#define RUN_SIZE      1024 /* block size of a run, also its alignment */
+#define RUN_PAYLOAD   (RUN_SIZE - WSIZE) /* so runs back to back stay aligned */
+#define RUN_SLOTS     128  /* max slots per run (bits in used bitmap) */
+#define SLAB_DEMAND   64   /* requests of a class before its first run */
+#ifdef MM_64
+#define SLAB_SPAN     (1ULL << 36) /* heap bytes covered by slab_map */
+#else
+#define SLAB_SPAN     (1ULL << 32) /* heap bytes covered by slab_map */
+#endif
+
+/* Class of a request (1 - SLAB_MAX bytes) and object size of a class */
+#define SLAB_CLASS(size) (((size) - 1) / DSIZE)
+#define SLAB_SIZE(cls)   (((cls) + 1) * DSIZE)
+
+/* Run holding pointer p and index of its slab_map bit */
+#define RUN_OF(p)  ((slab_run *)((size_t)(p) & ~(size_t)(RUN_SIZE - 1)))
+#define RUN_BIT(p) (((size_t)(p) - (size_t)heap_base) / RUN_SIZE)
+
+/* Test, set and clear the slab_map bit of the run holding p (the words 
+ * are shared by all arenas, so updates are atomic with threads) */
+#define IS_SLAB(p) ((char *)(p) > heap_base && RUN_BIT(p) < \
+                        (SLAB_SPAN / RUN_SIZE) && \
+                        (slab_map[RUN_BIT(p) >> 6] >> (RUN_BIT(p) & 63)) & 1)
+#ifdef MM_THREADS
+#define SET_SLAB(p)   __atomic_fetch_or(&slab_map[RUN_BIT(p) >> 6], \
+                        1ULL << (RUN_BIT(p) & 63), __ATOMIC_RELAXED)
+#define CLEAR_SLAB(p) __atomic_fetch_and(&slab_map[RUN_BIT(p) >> 6], \
+                        ~(1ULL << (RUN_BIT(p) & 63)), __ATOMIC_RELAXED)
+#else
+#define SET_SLAB(p)   (slab_map[RUN_BIT(p) >> 6] |= 1ULL << (RUN_BIT(p) & 63))
+#define CLEAR_SLAB(p) (slab_map[RUN_BIT(p) >> 6] &= ~(1ULL << \
+                        (RUN_BIT(p) & 63)))
+#endif
+
+/* 
+ * Quick lists : one list per block size of up to QUICK_MAX bytes, linked 
+ * through the first payload word, drained once they hold QUICK_BYTES
+ */
+
+#define QUICK_MAX      128
+#define QUICK_LISTS    (QUICK_MAX / DSIZE + 1)
+#define QUICK_BYTES    (4 * 1024)
+
+/* 
+ * Region arenas : chunks of REGION_CHUNK bytes by default. A request of
+ * more than a quarter of the chunk size gets a chunk of its own, so that 
+ * at most a quarter of a chunk is left unused at its end
+ */
+
+#define REGION_CHUNK   (16 * 1024)
+#define REGION_HDR     ALIGN(sizeof(region_chunk)) /* bytes before payload */
+#define REGION_BIG(r)  ((r)->chunk_size / 4)
+
+/* 
+ * Incremental checks : blocks changed since the last mm_checkheap_incr,
+ * recorded only once it has been called. A full check is done instead when
+ * more than DIRTY_MAX blocks changed
+ */
+
+#define DIRTY_MAX      64
+#define MARK_DIRTY(a, bp)   do { if (check_incr) mark_dirty(a, bp); } while (0)
+#define FORGET_DIRTY(a, bp) do { if (check_incr) forget_dirty(a, bp); } \
+                        while (0)
+
 /* Given block ptr bp, get next free block address and previous block address */
 
-#define NEXTFREE(bp)  ((!(*(unsigned int *)(bp)))? 0 :((char*)(heap_listp) + \
-                        *(unsigned int *)(bp)))
-#define PREVFREE(bp)  ((!(*((unsigned int *)(bp) + 1))) ? 0 :((char*)\
-                        (heap_listp) + *((unsigned int *)(bp)+1)))
+#define NEXTFREE(bp)  ((!(*(word_t *)(bp)))? 0 :((char*)(heap_base) + \
+                        *(word_t *)(bp)))
+#define PREVFREE(bp)  ((!(*((word_t *)(bp) + 1))) ? 0 :((char*)\
+                        (heap_base) + *((word_t *)(bp)+1)))
+
+/* Given block ptr bp, get and put the pointer to a word of memory using 
+ * offset */
+#define GETPTR(bp) ((!(*(word_t *)(bp)))? 0 :((char*)(heap_base) \
+                        + *(word_t *)(bp)))
+#define PUTPTR(bp,val) (((val) == 0) ? (*(word_t *)(bp) = 0):(*\
+                        (word_t *)(bp) = ((char*)(val)- \
+                                (char*)(heap_base))))
+
+
+/* Given block ptr bp, get and put the successor & predessor to a word of 
+ * memory in a free block using offset */
+#define WRITESUCCESSOR(bp,val) (((val) == 0) ? (*(word_t *)(bp) = 0):\
+                (*(word_t *)(bp) = ((char*)(val)- (char*)(heap_base))))
+
+#define WRITEPREDESSOR(bp,val) (((val) == 0) ? ((*((word_t *)(bp) + 1)) \
+                        = 0):(*((word_t *)(bp) + 1) = ((char*)(val) - \
+                                        (char*)(heap_base))))
+
+
+/* Get the head of seggregated list at index i of arena a
+ */
+
+
+#define BUCKET_ELEM(a,i) (&(a)->buckets[i])
 
-/* Given block ptr bp, get and put the pointer to 4 byte memory using offset */
-#define GETPTR(bp) ((!(*(unsigned int *)(bp)))? 0 :((char*)(heap_listp) \
-                        + *(unsigned int *)(bp)))
-#define PUTPTR(bp,val) (((val) == 0) ? (*(unsigned int *)(bp) = 0):(*\
-                        (unsigned int *)(bp) = ((char*)(val)- \
-                                (char*)(heap_listp))))
+/*
+ * Large block tree : free blocks of the last bucket form a splay tree 
+ * ordered by size then address, the children are kept as offsets in the 
+ * successor (left) and predecessor (right) words and the root is the head
+ * of the last bucket
+ */
+
+#define LEFT(bp)  NEXTFREE(bp)
+#define RIGHT(bp) PREVFREE(bp)
+#define SET_LEFT(bp,val)  WRITESUCCESSOR(bp,val)
+#define SET_RIGHT(bp,val) WRITEPREDESSOR(bp,val)
+#define TREE_LESS(s1, p1, s2, p2) ((s1) < (s2) || ((s1) == (s2) && \
+                        (char *)(p1) < (char *)(p2)))
+
+
+/* 
+ * Slab run header, at the start of the run payload and followed by the 
+ * slots. Runs with at least one free slot are kept in a doubly linked 
+ * list per class (slab_partial of the arena)
+ */
+
+typedef struct slab_run 
+{
+        struct slab_run * next;  /* next partial run of the same class */
+        struct slab_run * prev;  /* previous partial run of the same class */
+        unsigned short size;     /* object size of the class */
+        unsigned short nslots;   /* number of slots in the run */
+        unsigned short nfree;    /* number of free slots */
+        unsigned short cls;      /* slab class */
+        unsigned long long used[RUN_SLOTS / 64]; /* bit set for used slot */
+} __attribute__((aligned(ALIGNMENT))) slab_run; /* slots stay aligned */
+
+/*
+ * Arena : a heap (prologue, blocks, epilogue between lo and brk) with its
+ * seggregated lists and slab runs
+ */
+
+typedef struct arena 
+{
+        char * heap_listp;  /* Pointe to first block (prologue) */
+        char * lo;          /* start of the heap */
+        char * brk;         /* end of the heap, just after the epilogue */
+        char * limit;       /* end of the span of the arena (threads) */
+
+        /* buckets : heads of the seggregated lists as offsets from 
+         * heap_base, the last one is the root of the large block tree */
+        word_t buckets[BUCKET];
+
+        /* bucket_map : bit i is set when seggregated list i is non-empty,
+         * kept in sync with the list heads by updateList */
+        unsigned long long bucket_map;
+
+        slab_run * slab_partial[SLAB_CLASSES]; /* partial runs per class */
+
+        /* slab_demand : requests seen per class. A class only gets runs 
+         * after SLAB_DEMAND requests, so that a few small requests do not
+         * cost a run */
+        unsigned int slab_demand[SLAB_CLASSES];
+
+        char * quick[QUICK_LISTS]; /* quick list heads by size / DSIZE */
+        size_t quick_bytes;        /* bytes held by the quick lists */
+
+        size_t trim_threshold; /* see TRIM_THRESHOLD */
+        int trimmed;        /* the heap was trimmed since it last grew */
+
+        /* dirty : blocks changed since the last mm_checkheap_incr, all of
+         * them when dirty_all is set. check_list is the next seggregated 
+         * list it walks */
+        char * dirty[DIRTY_MAX];
+        unsigned int ndirty;
+        int dirty_all;
+        unsigned int check_list;
+#ifdef MM_STATS
+        mm_stats_t stats;   /* counters of the arena, see mm_stats */
+#endif
+#ifdef MM_THREADS
+        pthread_mutex_t lock;
+        void * remote;      /* stack of blocks freed by other threads */
+#endif
+} arena_t;
 
+/*
+ * Region arena : the chunks are linked in the order they were taken, the 
+ * bump pointer runs from the first one on. After a reset it starts again 
+ * at the first chunk and goes on through the ones already taken. Chunks 
+ * of big requests are on a list of their own, freed by the reset
+ */
+
+typedef struct region_chunk
+{
+        struct region_chunk * next; /* next chunk of the arena */
+} region_chunk;
+
+struct mm_arena
+{
+        char * ptr;               /* next free byte of the current chunk */
+        char * end;               /* end of the current chunk */
+        region_chunk * first;     /* first chunk, NULL before any */
+        region_chunk * cur;       /* current chunk */
+        region_chunk * big;       /* chunks of requests above REGION_BIG */
+        size_t chunk_size;        /* bytes of a chunk, header included */
+};
+
+#ifdef MM_THREADS
+
+/* 
+ * Thread constants : the memlib heap is split in MM_ARENAS spans of 
+ * ARENA_SPAN bytes (a multiple of RUN_SIZE so runs stay aligned), the 
+ * arena of a block is found from its offset in the heap
+ */
+
+#define MM_ARENAS   8
+#define ARENA_SPAN  ((MAX_HEAP / MM_ARENAS) & ~(size_t)(RUN_SIZE - 1))
+#define ARENA_OF(p) (&arenas[((char *)(p) - heap_base) / ARENA_SPAN])
+#define TCACHE_MAX  32  /* freed slots kept per class by a thread */
+
+#define ARENA_LOCK(a)   pthread_mutex_lock(&(a)->lock)
+#define ARENA_UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+#else
+#define MM_ARENAS   1
+#define ARENA_LOCK(a)
+#define ARENA_UNLOCK(a)
+#endif
 
-/* Given block ptr bp, get and put the successor & predessor to 4 byte memory 
- *  in a free block using offset */
-#define WRITESUCCESSOR(bp,val) (((val) == 0) ? (*(unsigned int *)(bp) = 0):\
-                (*(unsigned int *)(bp) = ((char*)(val)- (char*)(heap_listp))))
+#ifndef DRIVER
+
+/*
+ * Huge blocks : requests of MMAP_THRESHOLD bytes or more get a mapping of
+ * their own, with the length of the mapping in the word before the 
+ * payload. Such blocks are recognized by lying outside the heap
+ */
 
-#define WRITEPREDESSOR(bp,val) (((val) == 0) ? ((*((unsigned int *)(bp) + 1)) \
-                        = 0):(*((unsigned int *)(bp) + 1) = ((char*)(val) - \
-                                        (char*)(heap_listp))))
+#define MMAP_THRESHOLD (256 * 1024)
+#define MMAP_HDR       MAX(ALIGNMENT, sizeof(size_t)) /* bytes before bp */
+#define MMAP_LEN(bp)   (*(size_t *)((char *)(bp) - sizeof(size_t)))
+#define IS_MMAPPED(p)  ((char *)(p) < (char *)mem_heap_lo() || \
+                        (char *)(p) > (char *)mem_heap_hi())
+#endif
 
+/* mem_sbrk takes an int, larger increments are taken in pieces */
+#define SBRK_MAX       (1 << 30)
 
-/* Get the head of seggregated list at index i with the top of seggregated list
- * pointed by bucket_ptr
+/* 
+ * Giving memory back : a free last block of trim_threshold bytes or more
+ * is cut down to TRIM_KEEP bytes (the rest of the heap goes back to 
+ * memlib), the pages inside other free blocks of RELEASE_MIN bytes or 
+ * more are released but the blocks stay in the heap. The threshold of an
+ * arena starts at TRIM_THRESHOLD and doubles, up to TRIM_MAX, each time 
+ * its heap grows back after a trim, since pages given back and taken
+ * again cost a page fault each. Like the one of glibc, it is never 
+ * lowered again (mm_init keeps it)
  */
 
+#define TRIM_THRESHOLD (128 * 1024)
+#define TRIM_MAX       (32 * 1024 * 1024)
+#define TRIM_KEEP      (64 * 1024)
+#define RELEASE_MIN(a) (2 * (a)->trim_threshold)
 
-#define BUCKET_ELEM(i) ((unsigned int *)(bucket_ptr) + i)
+/* 
+ * Counters of mm_stats, kept per arena under its lock. Without MM_STATS 
+ * they are not even evaluated
+ */
 
+#ifdef MM_STATS
+_Static_assert(BUCKET <= MM_STATS_CLASSES && SLAB_CLASSES <= MM_STATS_CLASSES,
+		"mm_stats_t has fewer classes than mm.c");
+#define STAT_ADD(a, field, n) ((a)->stats.field += (n))
+#else
+#define STAT_ADD(a, field, n) ((void)0)
+#endif
+#define STAT_INC(a, field) STAT_ADD(a, field, 1)
 
 /* $end mallocmacros */
 
 /* Global variables */
-static char *heap_listp = 0;  /* Pointe to first block */  
 
-/* start variable will keep the pointer to the node for the 
- * current seggregated list in action 
- * If seggregated list 1 is being used , start will point to the node
- * pointed by the same list's head node.
- * After start is changed or modified, start contents will be modified 
- * to the head node of the same list
+/* heap_base : start of the memlib heap, list offsets are taken from it */
+static char *heap_base = 0;
+
+static arena_t arenas[MM_ARENAS];
+
+/*
+ * slab_map : bit i set when the RUN_SIZE bytes at heap_base + i*RUN_SIZE
+ * are a run, slab_map_hi is one past the highest word ever set (cleared 
+ * up to there by mm_init)
  */
 
-static char * start = 0; /* Pointer to root of free list */
+static unsigned long long slab_map[SLAB_SPAN / RUN_SIZE / 64];
+static size_t slab_map_hi = 0;
+
+/* check_incr : set by the first mm_checkheap_incr, see MARK_DIRTY */
+static int check_incr = 0;
+
+#ifdef MM_THREADS
 
 /*
- * Bucket_number : It keeps track of the head node which can 
- * be obtained by indexing into the bucket pointer
- * findList function will get the index based on the size of the block 
- * requested and update the index to bucket_number 
+ * Per thread state : the arena of the thread and its cache of freed slab
+ * slots, linked through their first word. tcache_key only serves to flush
+ * the cache when the thread exits
  */
 
-static char * bucket_ptr = 0;/* Start of the seggregated lsit array*/
-static int bucket_number = 0;/*global variable to track the */
-//static char * end = 0 ; /* Pointer to end of free list */
+static __thread arena_t * my_arena = NULL;
+static __thread struct 
+{
+        void * head[SLAB_CLASSES];
+        unsigned int count[SLAB_CLASSES];
+} tcache;
+static unsigned int next_arena = 0;
+static pthread_key_t tcache_key;
+#endif
 
+#if defined(MM_THREADS) && !defined(DRIVER)
+/* mm_ready : set once mm_init is done, checked before pthread_once */
+static pthread_once_t mm_once = PTHREAD_ONCE_INIT;
+static int mm_ready = 0;
+#endif
 
 /* Function prototypes for internal helper routines */
 
+/*
+ * arena_init : lays out the prologue and epilogue of an empty arena heap 
+ * at the start of [lo, limit) and extends it by CHUNKSIZE
+ *
+ * parameters : arena, start and end of its span
+ */
+
+static int arena_init(arena_t *a, char *lo, char *limit);
+
+/*
+ * arena_sbrk : grows the heap of the arena by incr bytes (mem_sbrk for the
+ * only arena, the span of the arena with threads)
+ *
+ * parameters : arena, increment in bytes
+ */
+
+static void *arena_sbrk(arena_t *a, size_t incr);
+
+/*
+ * heap_sbrk : mem_sbrk for any size_t increment
+ *
+ * parameter : incr (bytes)
+ * output : start of the new area, or (void *)-1
+ */
+
+static void *heap_sbrk(size_t incr);
+
+#ifndef DRIVER
+/*
+ * mmap_malloc, mmap_free, mmap_realloc : malloc, free and realloc of huge
+ * blocks, each in a mapping of its own
+ */
+
+static void *mmap_malloc(size_t size);
+static void mmap_free(void *bp);
+static void *mmap_realloc(void *bp, size_t size);
+#endif
+
+/*
+ * arena_malloc, arena_free, arena_realloc : malloc, free and realloc in the
+ * given arena, which the caller has locked
+ *
+ * parameters : arena, then as malloc, free and realloc
+ */
+
+static void *arena_malloc(arena_t *a, size_t size);
+static void arena_free(arena_t *a, void *bp);
+static void *arena_realloc(arena_t *a, void *ptr, size_t size);
+
+/*
+ * block_free : marks a block of the arena free and coalesces it at once
+ *
+ * parameters : arena, block pointer
+ */
+
+static void block_free(arena_t *a, void *bp);
+
+/*
+ * drain_quick : frees and coalesces every block of the quick lists
+ *
+ * parameter : arena
+ */
+
+static void drain_quick(arena_t *a);
+
+/*
+ * thread_arena : arena of the calling thread, chosen round robin on its 
+ * first call (always the only arena without threads)
+ */
+
+static arena_t *thread_arena(void);
+
+#ifdef MM_THREADS
+
+/*
+ * remote_free : pushes a block of arena a freed by another thread on the
+ * remote stack of a
+ *
+ * parameters : arena, block pointer
+ */
+
+static void remote_free(arena_t *a, void *bp);
+
+/*
+ * drain_remote : frees every block on the remote stack of the arena, which
+ * the caller has locked
+ *
+ * parameter : arena
+ */
+
+static void drain_remote(arena_t *a);
+
+/*
+ * tcache_flush : gives every slot in the cache of the exiting thread back
+ * to its arena
+ *
+ * parameter : unused (pthread key value)
+ */
+
+static void tcache_flush(void *unused);
+
+/*
+ * fork_prepare, fork_parent, fork_child : lock every arena before fork 
+ * and unlock them after it in both processes
+ */
+
+#ifndef DRIVER
+static void fork_prepare(void);
+static void fork_parent(void);
+static void fork_child(void);
+#endif
+#endif
+
+/*
+ * lazy_init : calls mm_init on the first call of malloc or free
+ *
+ * output : 0, or -1 if the heap could not be set up
+ */
+
+static int lazy_init(void);
+
+#if defined(MM_THREADS) && !defined(DRIVER)
+/*
+ * mm_init_once : mm_init for pthread_once, sets mm_ready when it succeeds
+ */
+
+static void mm_init_once(void);
+#endif
+
 /*
  * extend_heap : extends the heap by number of words 
  *
- * parameter : words
+ * parameter : arena, words
  */
 
-static void *extend_heap(size_t words);
+static void *extend_heap(arena_t *a, size_t words);
 
 /*
  * place : place the block at the block pointed by bp and splits the block
  * i//f actual size of block is greater than 16 bytes. Places removes the block 
  * from the seggregated list and joins other two blocks
  *
- * parameter : block pointer, required size
+ * parameter : arena, block pointer, required size
  */
 
-static void place(void *bp, size_t asize);
+static void place(arena_t *a, void *bp, size_t asize);
 
 /*
  * find_fit : searches the free list for first fit and returns
  * the pointer to the block
  *
- * parameter : actual size of block
+ * parameter : arena, actual size of block
  */
 
-static void *find_fit(size_t asize);
+static void *find_fit(arena_t *a, size_t asize);
 
 /*
  * coalesce : joins two free blocks if they are adjacent to each other
  * and combines the Next Free and Prev Free blocks together and if the
  * block's next FREE is null, it moves the previous block to null. If 
  * bloc is at the begining of the list, it sets the next block previous 
- * pointer to NULL and start points to Next block
+ * pointer to NULL and the head points to Next block
  *
- * parameter : block pointer
+ * parameter : arena, block pointer
  */
 
 
 
-static void *coalesce(void *bp);
+static void *coalesce(arena_t *a, void *bp);
 
 /*
- * checkblock : check the 8 byte alignment of the block 
+ * checkblock : check the ALIGNMENT of the block 
  * parameter : block pointer
  */
 
 static void checkblock(void *bp);
 
 /*
- * movFreeBlock_top : moving the newly freed block to the top of the list
- * or the large block which is split after allocating heap for the requested
- * block in case the required size is less than 16 bytes of the total size
+ * checkarena : runs the heap checks of mm_checkheap on one arena
  *
- * parameter : block pointer
+ * parameters : arena, verbose
  */
 
-
-static void movFreeBlock_top(void * bp);
+static void checkarena(arena_t *a, int verbose);
 
 /*
- * joinTwoBlocks : It takes care of combining Next and free blocks of adjacent 
- * block in case the block pointed to by bp is getting coalesced with the 
- * adjacent block .
- * It also takes care when place request for heap allocation is in process by 
- * taking care of the same block's Previous and Next nodes
+ * mark_dirty, forget_dirty : records a changed block in the dirty set of
+ * the arena, drops a block which no longer exists from it
  *
- * parameter : pointer to block (bp) , next (NEXT - 1 for hadling next block 
- * nodes, PREV-0 for handling previous block's nodes, CURR- 0 for handling its 
- * nodes
+ * parameters : arena, block pointer
  */
 
-static void joinTwoBlocks(void * bp,int next);
+static void mark_dirty(arena_t *a, void *bp);
+static void forget_dirty(arena_t *a, void *bp);
 
 /*
- * findList : It helps in finding the seggregated list based on the size of the
- * block request. It sets the global pointer start to the value located by head 
- * of the desired seggregated list and sets the global variable to bucket_number
+ * checkdirty : checks one block of the dirty set, its neighbours in the 
+ * heap and its place in the seggregated lists or slab runs
  *
- * parameters : size (size of the block)
+ * parameters : arena, block pointer
  */
 
-static void findList(size_t size);
+static void checkdirty(arena_t *a, char *bp);
 
 /*
- * updateList - updates the value of global start variable to the desired 
- * seggregated list (found by findList). bucket_number set by findList function
- * becomes an index to bucket_ptr. Start is updated to that head. 
+ * checklist : checks links, range and bucket of every block of one 
+ * seggregated list (the whole tree for the last one)
+ *
+ * parameters : arena, index of the list
  */
 
-static void updateList();
+static void checklist(arena_t *a, unsigned int index);
 
 /*
  * movFreeBlock_top : moving the newly freed block to the top of the list
  * or the large block which is split after allocating heap for the requested
  * block in case the required size is less than 16 bytes of the total size
  *
- * parameter : block pointer
+ * parameter : arena, block pointer
  */
-static void movFreeBlock_top(void * bp) 
-{
-   if (bp != start) 
-   {
-            char * temp = start;
-            start = (char *) bp;
-            WRITESUCCESSOR(bp,temp);
-            WRITEPREDESSOR(bp,0);
-            if (temp!=0) { 
-                     WRITEPREDESSOR(NEXTFREE(bp),bp);
-            }
-   }
-}
-/* 
- *  * mm_init - Initialize the memory manager 
- *  This initializes a 12 words for storing the heads of all seggregated list
- *  and then allocates 4 words for epilogue and prologue headers. 
- *  It extends the heap by chunksize by chunksize of 256 bytes
- */   
 
 
-int mm_init(void) 
-{
-	start = 0;
+static void movFreeBlock_top(arena_t *a, void * bp);
 
-	unsigned int number_buckets = ((BUCKET % 2)?( BUCKET + 1) : BUCKET); 
-	size_t size = 4*WSIZE + number_buckets * WSIZE;
+/*
+ * joinTwoBlocks : It takes care of combining Next and free blocks of adjacent 
+ * block in case the block pointed to by bp is getting coalesced with the 
+ * adjacent block .
+ * It also takes care when place request for heap allocation is in process by 
+ * taking care of the same block's Previous and Next nodes
+ *
+ * parameter : arena, pointer to block (bp) , next (NEXT - 1 for hadling next 
+ * block nodes, PREV-0 for handling previous block's nodes, CURR- 0 for 
+ * handling its nodes
+ */
 
-	if ((heap_listp = mem_sbrk(size)) == (void *)-1) 
-		return -1;
-			   
-	bucket_ptr = (char * ) heap_listp ;
-	unsigned int i ;
-	for (i = 0 ; i < number_buckets; i++ ) 
-	{
-		PUTPTR(BUCKET_ELEM(i),0);
-	}
-	heap_listp = (char * ) bucket_ptr + number_buckets*WSIZE;
-	PUT(heap_listp, 0);                          /* Alignment padding */
-	PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-	PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
+static void joinTwoBlocks(arena_t *a, void * bp,int next);
 
-	PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
-	heap_listp += (2*WSIZE);
+/*
+ * updateList - sets or clears bit index of the bucket_map of the arena as
+ * seggregated list index is empty or not after it has changed
+ *
+ * parameters : arena, index of the list
+ */
 
-	char * bp = NULL;
-	if ((bp=extend_heap(CHUNKSIZE/WSIZE)) == NULL) 
-		    return -1;
-	    return 0;
-}
+static void updateList(arena_t *a, unsigned int index);
 
+/*
+ * tree_splay : top down splay of the tree rooted at t for the key (size, 
+ * bp). Returns the new root, which is bp when it is in the tree or else 
+ * its nearest neighbour in tree order
+ *
+ * parameters : root, size and address of the key
+ */
 
+static char *tree_splay(char *t, size_t size, char *bp);
 
 /*
- * findList : It helps in finding the seggregated list based on the size of the
- * block request. It sets the global pointer start to the value located by head 
- * of the desired seggregated list and sets the global variable to bucket_number
+ * tree_insert : inserts the free block as the new root of the large block
+ * tree whose root is at head
  *
- * parameters : size (size of the block)
+ * parameter : head of the tree, block pointer
  */
-static void findList(size_t size) 
-{
-        unsigned int index = BINDEX12;
 
-        if(size <= BUCKET1) 
-        {
-                index = BINDEX1;
-        } else if (size >= BUCKET1 && size <= BUCKET2) 
-        {
-                index = BINDEX2;
-        } else if (size >= BUCKET2 && size <= BUCKET3)
-        {
-                index = BINDEX3;
-        } else if (size >= BUCKET3 && size <= BUCKET4) 
-        {
-                index = BINDEX4;
-        } else if (size >= BUCKET4 && size <= BUCKET5)
-        {
-                index = BINDEX5;
-        } else if (size >= BUCKET5 && size <= BUCKET6)
-        {
-                index = BINDEX6;
-        } else if (size >= BUCKET6 && size <= BUCKET7)
-        {
-                index = BINDEX7;
-        } else if (size >= BUCKET7 && size <= BUCKET8)
-        {
-                index = BINDEX8;
-        } else if (size >= BUCKET8 && size <= BUCKET9) 
-        {
-                index = BINDEX9;
-        } else if (size >= BUCKET9 && size <= BUCKET10)
-        {
-                index = BINDEX10;
-        } else if (size >= BUCKET10 && size <= BUCKET11)
-        {
-                index = BINDEX11;
-        } else 
-        {
-                index = BINDEX12;
-        }
+static void tree_insert(word_t *head, void *bp);
 
+/*
+ * tree_remove : removes the free block from the large block tree whose 
+ * root is at head
+ *
+ * parameter : head of the tree, block pointer
+ */
 
-        start = GETPTR(BUCKET_ELEM(index));
-        bucket_number = index;
-}
+static void tree_remove(word_t *head, void *bp);
 
 /*
- * updateList - updates the value of global start variable to the desired 
- * seggregated list (found by findList). bucket_number set by findList function
- * becomes an index to bucket_ptr. Start is updated to that head. 
+ * tree_fit : best fit in the large block tree, i.e the smallest (then 
+ * lowest) free block of at least asize bytes or NULL
+ *
+ * parameters : root of the tree, actual size of block
  */
-static void updateList() 
-{
-        PUTPTR(BUCKET_ELEM(bucket_number),start);
 
-}
+static char *tree_fit(char *t, size_t asize);
 
+/*
+ * checktree : checks order, size and range of the large block tree below
+ * t and returns the number of blocks in it
+ *
+ * parameter : arena, root of the tree, lo and hi (the nodes every block 
+ * of the tree must lie between in tree order, NULL for no bound)
+ */
 
+static int checktree(arena_t *a, char *t, char *lo, char *hi);
 
-/* 
- *  _malloc - Allocate a block with at least size bytes of payload 
- *  From the size, it finds for the fit in the appropriate seggregated 
- *  list                  
+/*
+ * alloc_aligned : allocates a block with payload of size bytes aligned to
+ * align bytes (a power of two). A fit large enough for any alignment is
+ * found, the aligned block is carved out and the free space in front and
+ * behind is put back in the seggregated lists
+ *
+ * parameters : arena, size (payload bytes), align (alignment)
  */
 
-void *malloc(size_t size) 
-{
-	size_t asize;      /* Adjusted block size */
-	size_t extendsize; /* Amount to extend heap if no fit */
-	char *bp;      
+static void *alloc_aligned(arena_t *a, size_t size, size_t align);
 
-	/* $end mmmalloc */
-	if (heap_listp == 0){
-	mm_init();
+/*
+ * find_aligned_fit : searches the seggregated lists for the first free 
+ * block which can hold a block of asize bytes with payload aligned to 
+ * align bytes, leaving either nothing or a valid free block in front
+ *
+ * parameters : arena, asize (block size), align (alignment)
+ */
+
+static void *find_aligned_fit(arena_t *a, size_t asize, size_t align);
+
+/*
+ * slab_malloc : returns a free slot of the class of size from the first
+ * partial run of the class, creating a run if there is none
+ *
+ * parameters : arena, size (request size, at most SLAB_MAX)
+ */
+
+static void *slab_malloc(arena_t *a, size_t size);
+
+/*
+ * slab_free : marks the slot of bp free in its run. An empty run is given
+ * back to the heap unless it is the only partial run of its class
+ *
+ * parameters : arena, bp (pointer to the slot)
+ */
+
+static void slab_free(arena_t *a, void *bp);
+
+/*
+ * arena_release : trims the heap of the arena if bp is a large last block
+ * or releases the pages of [lo, hi) inside bp if it is large
+ *
+ * parameters : arena, bp (free block, after coalescing), lo and hi (the
+ * part of bp which may still be in memory)
+ */
+
+static void arena_release(arena_t *a, void *bp, char *lo, char *hi);
+
+/*
+ * movFreeBlock_top : moving the newly freed block to the top of the list
+ * or the large block which is split after allocating heap for the requested
+ * block in case the required size is less than 16 bytes of the total size
+ *
+ * parameter : arena, block pointer
+ */
+static void movFreeBlock_top(arena_t *a, void * bp)
+{
+   unsigned int index = BUCKET_INDEX(GET_SIZE(HDRP(bp)));
+   word_t * head = BUCKET_ELEM(a,index);
+
+   MARK_DIRTY(a, bp);
+   if (index == LAST_BUCKET)
+   {
+            tree_insert(head,bp);
+   }
+   else if (bp != GETPTR(head))
+   {
+            char * temp = GETPTR(head);
+            PUTPTR(head,bp);
+            WRITESUCCESSOR(bp,temp);
+            WRITEPREDESSOR(bp,0);
+            if (temp!=0) {
+                     WRITEPREDESSOR(NEXTFREE(bp),bp);
+            }
+   }
+   updateList(a,index);
+}
+/*
+ *  * mm_init - Initialize the memory manager
+ *  This clears the slab map and initializes every arena (one span of the
+ *  heap per arena with threads, reserved here)
+ */
+
+
+int mm_init(void)
+{
+	memset(slab_map, 0, slab_map_hi * sizeof(slab_map[0]));
+	slab_map_hi = 0;
+#ifndef DRIVER
+	mem_init();
+#endif
+
+#ifdef MM_THREADS
+	static int key_created = 0;
+	unsigned int i;
+	char * span;
+
+	if (!key_created)
+	{
+		pthread_key_create(&tcache_key, tcache_flush);
+		key_created = 1;
+	}
+	memset(&tcache, 0, sizeof(tcache));
+
+	/* One heap_sbrk per span, which keeps each increment small enough */
+	for (i = 0 ; i < MM_ARENAS; i++ )
+	{
+		if ((span = heap_sbrk(ARENA_SPAN)) == (void *)-1)
+			return -1;
+		if (i == 0)
+			heap_base = span;
+		if (arena_init(&arenas[i], span, span + ARENA_SPAN) == -1)
+			return -1;
+	}
+	/* Any run of any arena may set a bit, so clear all of them next time */
+	slab_map_hi = (MM_ARENAS * ARENA_SPAN / RUN_SIZE + 63) / 64;
+	return 0;
+#else
+	heap_base = (char *)mem_heap_hi() + 1;
+	return arena_init(arenas, heap_base, NULL);
+#endif
+}
+
+#if defined(MM_THREADS) && !defined(DRIVER)
+/*
+ * mm_init_once : fork handlers are registered here, only once
+ */
+
+static void mm_init_once(void)
+{
+	if (mm_init() == 0)
+	{
+		__atomic_store_n(&mm_ready, 1, __ATOMIC_RELEASE);
+		/* After mm_ready, as pthread_atfork may call malloc */
+		pthread_atfork(fork_prepare, fork_parent, fork_child);
+	}
+}
+#endif
+
+/*
+ * lazy_init : with threads in a real program the first calls may race, so
+ * mm_init runs under pthread_once
+ */
+
+static int lazy_init(void)
+{
+#if defined(MM_THREADS) && !defined(DRIVER)
+	if (!__atomic_load_n(&mm_ready, __ATOMIC_ACQUIRE))
+	{
+		pthread_once(&mm_once, mm_init_once);
+		if (!__atomic_load_n(&mm_ready, __ATOMIC_ACQUIRE))
+			return -1;
+	}
+#else
+	if (heap_base == 0 && mm_init() == -1)
+	{
+		heap_base = 0;
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+/*
+ * arena_init : the heap of the arena starts with 4 words : alignment
+ * padding, prologue header and footer and the epilogue header. What was
+ * learnt about trimming is kept : a trim before mm_init counts as one 
+ * before the heap grows back
+ */
+
+static int arena_init(arena_t *a, char *lo, char *limit)
+{
+	char * p;
+	size_t trim_threshold = a->trim_threshold;
+	int trimmed = a->trimmed;
+
+	memset(a, 0, sizeof(*a));
+#ifdef MM_THREADS
+	pthread_mutex_init(&a->lock, NULL);
+#endif
+	a->lo = a->brk = lo;
+	a->limit = limit;
+	a->trim_threshold = MAX(trim_threshold, TRIM_THRESHOLD);
+	a->trimmed = trimmed;
+	a->dirty_all = 1;
+	if ((p = arena_sbrk(a, 4*WSIZE)) == (void *)-1)
+		return -1;
+	a->lo = p;
+
+	PUT(p, 0);                          /* Alignment padding */
+	PUT(p + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+	PUT(p + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+	PUT(p + (3*WSIZE), PACK(0, 1 | PREV_ALLOC)); /* Epilogue header */
+	a->heap_listp = p + (2*WSIZE);
+
+	if (extend_heap(a, CHUNKSIZE/WSIZE) == NULL)
+		return -1;
+	return 0;
+}
+
+/*
+ * arena_sbrk : the only arena takes mem_sbrk memory as it comes, with
+ * threads the arena only moves its own break within its span
+ */
+
+static void *arena_sbrk(arena_t *a, size_t incr)
+{
+	char * old = a->brk;
+
+#ifdef MM_THREADS
+	if (incr > (size_t)(a->limit - a->brk))
+		return (void *)-1;
+#else
+	if ((old = heap_sbrk(incr)) == (void *)-1)
+		return (void *)-1;
+#endif
+	a->brk = old + incr;
+	return old;
+}
+
+/*
+ * heap_sbrk : the pieces are contiguous, as nothing else moves the break
+ * in between
+ */
+
+static void *heap_sbrk(size_t incr)
+{
+	char * start = (char *)mem_heap_hi() + 1;
+	size_t piece;
+
+	for (; incr > 0; incr -= piece)
+	{
+		piece = MIN(incr, SBRK_MAX);
+		if (mem_sbrk(piece) == (void *)-1)
+			return (void *)-1;
+	}
+	return start;
+}
+
+/*
+ * thread_arena : the first call of a thread also registers tcache_key so
+ * that its cache is flushed when it exits
+ */
+
+static arena_t *thread_arena(void)
+{
+#ifdef MM_THREADS
+	if (my_arena == NULL)
+	{
+		my_arena = &arenas[__atomic_fetch_add(&next_arena, 1,
+				__ATOMIC_RELAXED) % MM_ARENAS];
+		pthread_setspecific(tcache_key, &tcache);
+	}
+	return my_arena;
+#else
+	return arenas;
+#endif
+}
+
+#ifdef MM_THREADS
+
+/*
+ * remote_free : the first word of the payload links the stack, which is
+ * pushed with compare and swap
+ */
+
+static void remote_free(arena_t *a, void *bp)
+{
+	void * head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+	do
+	{
+		*(void **)bp = head;
+	} while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * drain_remote : takes the whole stack at once, so there is no ABA problem
+ */
+
+static void drain_remote(arena_t *a)
+{
+	void * bp, * next;
+
+	if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL)
+		return;
+	bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+	while (bp != NULL)
+	{
+		next = *(void **)bp;
+		arena_free(a, bp);
+		bp = next;
 	}
+}
+
+#ifndef DRIVER
+/*
+ * fork_prepare : arenas are locked in order, as no thread holds two locks
+ * this cannot deadlock
+ */
+
+static void fork_prepare(void)
+{
+	unsigned int i;
+
+	for (i = 0 ; i < MM_ARENAS; i++ )
+		ARENA_LOCK(&arenas[i]);
+}
+
+static void fork_parent(void)
+{
+	unsigned int i;
+
+	for (i = 0 ; i < MM_ARENAS; i++ )
+		ARENA_UNLOCK(&arenas[i]);
+}
+
+/*
+ * fork_child : the child only has the thread which forked, so the locks
+ * are simply made new
+ */
+
+static void fork_child(void)
+{
+	unsigned int i;
+
+	for (i = 0 ; i < MM_ARENAS; i++ )
+		pthread_mutex_init(&arenas[i].lock, NULL);
+}
+#endif
+
+/*
+ * tcache_flush : the counts are left full so that free does not cache the
+ * slots again
+ */
+
+static void tcache_flush(void *unused)
+{
+	unsigned int cls;
+	void * bp, * next;
+
+	(void)unused;
+	for (cls = 0; cls < SLAB_CLASSES; cls++)
+	{
+		bp = tcache.head[cls];
+		tcache.head[cls] = NULL;
+		tcache.count[cls] = TCACHE_MAX;
+		for (; bp != NULL; bp = next)
+		{
+			next = *(void **)bp;
+			free(bp);
+		}
+	}
+}
+#endif
+
+
+
+/*
+ * updateList - keeps bit index of bucket_map set exactly while the head of
+ * seggregated list index is not empty
+ */
+static void updateList(arena_t *a, unsigned int index)
+{
+        if (GETPTR(BUCKET_ELEM(a,index)) != 0)
+        {
+                a->bucket_map |= 1ULL << index;
+        }
+        else
+        {
+                a->bucket_map &= ~(1ULL << index);
+        }
+}
+
+
+
+/*
+ *  _malloc - Allocate a block with at least size bytes of payload
+ *  A slot cached by the thread is taken first, otherwise the arena of the
+ *  thread is locked for arena_malloc
+ */
+
+void *malloc(size_t size)
+{
+	arena_t *a;
+	char *bp;
+
+	/* $end mmmalloc */
+	if (lazy_init() == -1)
+		return NULL;
 	/* $begin mmmalloc */
 	    /* Ignore spurious requests */
 	if (size == 0)
 	return NULL;
 
-	if (size <= DSIZE)            
-	    asize = 2*DSIZE;         
-	else 
+#ifndef DRIVER
+	if (size >= MMAP_THRESHOLD)
+		return mmap_malloc(size);
+#endif
+#ifdef MM_THREADS
+	if (size <= SLAB_MAX && tcache.head[SLAB_CLASS(size)] != NULL)
 	{
+		unsigned int cls = SLAB_CLASS(size);
+		bp = tcache.head[cls];
+		tcache.head[cls] = *(void **)bp;
+		tcache.count[cls]--;
+		return bp;
+	}
+#endif
+	a = thread_arena();
+	ARENA_LOCK(a);
+#ifdef MM_THREADS
+	drain_remote(a);
+#endif
+	bp = arena_malloc(a, size);
+	ARENA_UNLOCK(a);
+	return bp;
+}
+
+/*
+ *  arena_malloc - From the size, it finds for the fit in the appropriate
+ *  seggregated list of the arena (or a slab run for small requests) and
+ *  extends the heap of the arena when there is none
+ */
+
+static void *arena_malloc(arena_t *a, size_t size)
+{
+	size_t asize;      /* Adjusted block size */
+	size_t extendsize; /* Amount to extend heap if no fit */
+	char *bp;
 
-	    asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
+	/* Small requests come from slabs once their class is in demand */
+	if (size <= SLAB_MAX && (a->slab_partial[SLAB_CLASS(size)] != NULL ||
+				++a->slab_demand[SLAB_CLASS(size)] > SLAB_DEMAND))
+		return slab_malloc(a, size);
+
+	asize = ASIZE(size);
+	STAT_ADD(a, requested, size);
+
+	/* A block of the same size freed lately */
+	if (asize <= QUICK_MAX && (bp = a->quick[asize / DSIZE]) != NULL) {
+	    a->quick[asize / DSIZE] = *(char **)bp;
+	    a->quick_bytes -= asize;
+	    STAT_INC(a, quick_allocs);
+	    STAT_ADD(a, allocated, asize);
+	    return bp;
 	}
-	findList(asize);
-	/* Search the free list for a fit */
 
-	if ((bp = find_fit(asize)) != NULL) {  
-	    place(bp, asize);                 
+	/* Search the free list for a fit, again once the quick lists are
+	 * coalesced */
+
+	if ((bp = find_fit(a, asize)) != NULL || (a->quick_bytes > 0 &&
+				(drain_quick(a), bp = find_fit(a, asize)) != NULL)) {
+	    place(a, bp, asize);
 	    return bp;
 	}
 
-			    /* No fit found. Get more memory and 
+			    /* No fit found. Get more memory and
 			     * place the block */
-	extendsize = MAX(asize,CHUNKSIZE);   
-	if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
-	    return NULL;                   
-	place(bp, asize);       
+	extendsize = MAX(asize,CHUNKSIZE);
+	if ((bp = extend_heap(a, extendsize/WSIZE)) == NULL)
+	    return NULL;
+	place(a, bp, asize);
 	return bp;
-} 
+}
 
 /* 
  *  free - Free a block and then sets the NEXT Free and prev free pointer
@@ -482,27 +1336,200 @@ void *malloc(size_t size)
  *  block
  *              
  *  parameter - pointer to the block to be freed              
- */ 
+ *
+ *  A slot goes to the cache of the thread while it has room and a block of
+ *  another arena to the remote stack of that arena, otherwise the arena is
+ *  locked for arena_free
+ */
 void free(void *bp)
 {
+	arena_t *a;
+
 	/* $end mmfree */
-	if(bp == 0) 
+	if(bp == 0)
 		return;
 
-	/* $begin mmfree */
-	size_t size = GET_SIZE(HDRP(bp));
 	/* $end mmfree */
-	if (heap_listp == 0)
+	if (lazy_init() == -1)
+		return;
+	    /* $begin mmfree */
+#ifndef DRIVER
+	if (IS_MMAPPED(bp))
 	{
-		mm_init();
+		mmap_free(bp);
+		return;
+	}
+#endif
+	a = thread_arena();
+
+#ifdef MM_THREADS
+	if (IS_SLAB(bp))
+	{
+		unsigned int cls = RUN_OF(bp)->cls;
+		if (tcache.count[cls] < TCACHE_MAX)
+		{
+			*(void **)bp = tcache.head[cls];
+			tcache.head[cls] = bp;
+			tcache.count[cls]++;
+			return;
+		}
+	}
+	if (ARENA_OF(bp) != a)
+	{
+		remote_free(ARENA_OF(bp), bp);
+		return;
+	}
+#endif
+	ARENA_LOCK(a);
+#ifdef MM_THREADS
+	drain_remote(a);
+#endif
+	arena_free(a, bp);
+	ARENA_UNLOCK(a);
+}
+
+/*
+ *  arena_free - frees a block of the arena : slots go back to their run,
+ *  small blocks to their quick list and other blocks are coalesced
+ */
+
+static void arena_free(arena_t *a, void *bp)
+{
+	size_t size;
+
+	if (IS_SLAB(bp))
+	{
+		slab_free(a, bp);
+		return;
 	}
-	    /* $begin mmfree */
 
-	PUT(HDRP(bp), PACK(size, 0));
-	PUT(FTRP(bp), PACK(size, 0));
+	size = GET_SIZE(HDRP(bp));
+	if (size <= QUICK_MAX)
+	{
+		*(char **)bp = a->quick[size / DSIZE];
+		a->quick[size / DSIZE] = bp;
+		a->quick_bytes += size;
+		STAT_INC(a, quick_frees);
+		if (a->quick_bytes > QUICK_BYTES)
+			drain_quick(a);
+		return;
+	}
+	block_free(a, bp);
+}
+
+/*
+ *  block_free - clears the allocated bit of the block and coalesces it, 
+ *  then lets arena_release give back the pages of a large result
+ */
+
+static void block_free(arena_t *a, void *bp)
+{
+	size_t size;
+	char *lo, *hi, *next;
+
+	FORGET_DIRTY(a, bp);
+
+	/* Free neighbours below RELEASE_MIN were never released */
+	size = GET_SIZE(HDRP(bp));
+	STAT_INC(a, frees[BUCKET_INDEX(size)]);
+	lo = bp;
+	hi = (char *)bp + size;
+	if (!GET_PREV_ALLOC(HDRP(bp)) &&
+			GET_SIZE((char *)bp - DSIZE) < RELEASE_MIN(a))
+		lo = PREV_BLKP(bp);
+	next = NEXT_BLKP(bp);
+	if (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(next)) < RELEASE_MIN(a))
+		hi = next + GET_SIZE(HDRP(next));
+
+	PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), GET(HDRP(bp)));
+	CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
 	WRITESUCCESSOR(bp,0);
 	WRITEPREDESSOR(bp,0);
-	coalesce(bp);
+	arena_release(a, coalesce(a, bp), lo, hi);
+}
+
+/*
+ *  drain_quick - the blocks are freed list by list; as they are still 
+ *  marked allocated until then, the quick blocks next to each other are
+ *  coalesced as they are freed in turn
+ */
+
+static void drain_quick(arena_t *a)
+{
+	unsigned int i;
+	char *bp, *next;
+
+	STAT_INC(a, quick_drains);
+	for (i = 0; i < QUICK_LISTS; i++)
+	{
+		for (bp = a->quick[i]; bp != NULL; bp = next)
+		{
+			next = *(char **)bp;
+			block_free(a, bp);
+		}
+		a->quick[i] = NULL;
+	}
+	a->quick_bytes = 0;
+}
+
+/*
+ * arena_release - the single arena shrinks the memlib heap, with threads
+ * the arena only moves its own break and releases the pages above it.
+ * Free blocks of RELEASE_MIN bytes or more are kept released, so only the
+ * part which was allocated or in a smaller free block is released again.
+ * Released pages read as zero later, only the words kept in a free block
+ * (header, list or tree links, footer) must survive
+ */
+
+static void arena_release(arena_t *a, void *bp, char *lo, char *hi)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+	size_t cut;
+
+	if (size < a->trim_threshold)
+		return;
+
+	if (GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+	{
+		if (size >= RELEASE_MIN(a))
+		{
+			lo = MAX(lo, (char *)bp + DSIZE);
+			hi = MIN(hi, FTRP(bp));
+			if (lo < hi)
+				mem_release(lo, hi - lo);
+		}
+		return;
+	}
+
+	joinTwoBlocks(a,bp,CURR);
+	cut = size - TRIM_KEEP;
+#ifdef MM_THREADS
+	mem_release(a->brk - cut, cut);
+#else
+	/* The heap only gives back what mem_sbrk managed to shrink */
+	size_t piece, done;
+
+	for (done = 0; done < cut; done += piece)
+	{
+		piece = MIN(cut - done, SBRK_MAX);
+		if (mem_sbrk(-(int)piece) == (void *)-1)
+			break;
+	}
+	if ((cut = done) == 0)
+	{
+		movFreeBlock_top(a,bp);
+		return;
+	}
+#endif
+	a->brk -= cut;
+	a->trimmed = 1;
+	STAT_INC(a, trims);
+
+	PUT(HDRP(bp), PACK(size - cut, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), GET(HDRP(bp)));
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+	movFreeBlock_top(a,bp);
 }
 
 
@@ -519,9 +1546,11 @@ void free(void *bp)
  * nodes
  */
 
-static void joinTwoBlocks(void * bp,int next) 
+static void joinTwoBlocks(arena_t *a, void * bp,int next)
 {
     char * Blk = NULL;
+    unsigned int index;
+    word_t * head;
     switch (next) 
     {
             /* Handling next block nodes*/
@@ -536,13 +1565,22 @@ static void joinTwoBlocks(void * bp,int next)
             case CURR :
                     Blk = bp;
     }
+    FORGET_DIRTY(a, Blk);
+    index = BUCKET_INDEX(GET_SIZE(HDRP(Blk)));
+    head = BUCKET_ELEM(a,index);
+    if (index == LAST_BUCKET)
+    {
+        tree_remove(head,Blk);
+        updateList(a,index);
+        return;
+    }
     char * nextBlk = NEXTFREE(Blk);
     char * prevBlk = PREVFREE(Blk);
 
     
-    if (nextBlk == NULL && prevBlk == NULL ) 
+    if (nextBlk == NULL && prevBlk == NULL )
     {
-        start = 0 ;
+        PUTPTR(head,0);
     }
 
     
@@ -554,13 +1592,175 @@ static void joinTwoBlocks(void * bp,int next)
     if (nextBlk != NULL && prevBlk == NULL ) 
     {
         WRITEPREDESSOR(nextBlk,0);
-        start = nextBlk;
+        PUTPTR(head,nextBlk);
     }     
     if (nextBlk != NULL && prevBlk != NULL ) 
     {
         WRITESUCCESSOR(prevBlk,nextBlk);
         WRITEPREDESSOR(nextBlk,prevBlk);
     } 
+    updateList(a,index);
+}
+
+
+
+/*
+ * tree_splay : splits the tree into nodes less than the key (linked along
+ * their right children from l) and greater than the key (linked along 
+ * their left children from r) while walking down, rotating at every 
+ * zig-zig step, and hangs both halves under the last node reached
+ *
+ * parameters : root, size and address of the key
+ */
+
+static char *tree_splay(char *t, size_t size, char *bp) 
+{
+    char *l = NULL, *r = NULL, *lroot = NULL, *rroot = NULL, *y;
+
+    for (;;) 
+    {
+        if (TREE_LESS(size, bp, GET_SIZE(HDRP(t)), t)) 
+        {
+            if ((y = LEFT(t)) == NULL) 
+                break;
+            if (TREE_LESS(size, bp, GET_SIZE(HDRP(y)), y)) 
+            {
+                /* Rotate right */
+                SET_LEFT(t, RIGHT(y));
+                SET_RIGHT(y, t);
+                t = y;
+                if ((y = LEFT(t)) == NULL) 
+                    break;
+            }
+            /* Link right */
+            if (r != NULL) 
+                SET_LEFT(r, t);
+            else 
+                rroot = t;
+            r = t;
+            t = y;
+        }
+        else if (TREE_LESS(GET_SIZE(HDRP(t)), t, size, bp)) 
+        {
+            if ((y = RIGHT(t)) == NULL) 
+                break;
+            if (TREE_LESS(GET_SIZE(HDRP(y)), y, size, bp)) 
+            {
+                /* Rotate left */
+                SET_RIGHT(t, LEFT(y));
+                SET_LEFT(y, t);
+                t = y;
+                if ((y = RIGHT(t)) == NULL) 
+                    break;
+            }
+            /* Link left */
+            if (l != NULL) 
+                SET_RIGHT(l, t);
+            else 
+                lroot = t;
+            l = t;
+            t = y;
+        }
+        else 
+            break;
+    }
+
+    /* Assemble */
+    if (l != NULL) 
+    {
+        SET_RIGHT(l, LEFT(t));
+        SET_LEFT(t, lroot);
+    }
+    if (r != NULL) 
+    {
+        SET_LEFT(r, RIGHT(t));
+        SET_RIGHT(t, rroot);
+    }
+    return t;
+}
+
+/*
+ * tree_insert : splays the neighbour of bp to the root and splits the
+ * tree under bp
+ *
+ * parameter : head of the tree, block pointer
+ */
+
+static void tree_insert(word_t *head, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t = GETPTR(head);
+
+    if (t == NULL)
+    {
+        SET_LEFT(bp,0);
+        SET_RIGHT(bp,0);
+        PUTPTR(head,bp);
+        return;
+    }
+    t = tree_splay(t, size, bp);
+    if (TREE_LESS(size, bp, GET_SIZE(HDRP(t)), t))
+    {
+        SET_LEFT(bp,LEFT(t));
+        SET_RIGHT(bp,t);
+        SET_LEFT(t,0);
+    }
+    else
+    {
+        SET_RIGHT(bp,RIGHT(t));
+        SET_LEFT(bp,t);
+        SET_RIGHT(t,0);
+    }
+    PUTPTR(head,bp);
+}
+
+/*
+ * tree_remove : splays bp to the root, then splays its left subtree for 
+ * bp so its largest node (which has no right child) becomes the root 
+ * and takes the right subtree of bp
+ *
+ * parameter : head of the tree, block pointer
+ */
+
+static void tree_remove(word_t *head, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t = tree_splay(GETPTR(head), size, bp);
+    char *x;
+
+    if (LEFT(t) == NULL)
+    {
+        PUTPTR(head,RIGHT(t));
+        return;
+    }
+    x = tree_splay(LEFT(t), size, bp);
+    SET_RIGHT(x,RIGHT(t));
+    PUTPTR(head,x);
+}
+
+/*
+ * tree_fit : walks down from the root, going left after every fit to look
+ * for a tighter one and right otherwise. The block found is splayed to the
+ * root when place removes it
+ *
+ * parameters : root of the tree, actual size of block
+ */
+
+static char *tree_fit(char *t, size_t asize) 
+{
+    char *fit = NULL;
+
+    while (t != NULL) 
+    {
+        if (GET_SIZE(HDRP(t)) >= asize) 
+        {
+            fit = t;
+            t = LEFT(t);
+        }
+        else 
+            t = RIGHT(t);
+    }
+    return fit;
 }
 
 
@@ -568,107 +1768,187 @@ static void joinTwoBlocks(void * bp,int next)
 /*
  *  coalesce : combine two adjacent free blocks and handles the adjcent block
  *  free and previous pointers by calling joinTwoBlocks functions and moves the
- *  resultant block to the top of seggregated list
+ *  resultant block to the top of seggregated list of the arena. The previous block is
+ *  found free from the PREV_ALLOC bit of bp's header. The resultant block
+ *  always follows an allocated block.
  *
  *  
  *  parameter : block pointer
  *
  *  
  */
-static void *coalesce(void *bp) 
+static void *coalesce(arena_t *a, void *bp)
 {
-	size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
 	size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
 	size_t size = GET_SIZE(HDRP(bp));
 
-	char * start1 = start;
-	int prevBucket = bucket_number;
-
 	if (prev_alloc && next_alloc) {            /* Case 1 */
-	    findList(size); //Selecting the seggregated list and setting start 
-	    movFreeBlock_top(bp);//moving to top of the list
-	    updateList();//updating the seggregated list
+	    movFreeBlock_top(a,bp);//moving to top of the list
 	    return bp;
 	}
 
 	else if (prev_alloc && !next_alloc) {      /* Case 2 */
-	    findList(GET_SIZE(HDRP(NEXT_BLKP(bp))));
-	    joinTwoBlocks(bp,NEXT);
-	    updateList();
+	    joinTwoBlocks(a,bp,NEXT);
+	    STAT_INC(a, coalesces);
 
         /* Coalescing the next block*/
 	    size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-	    PUT(HDRP(bp), PACK(size, 0));
-	    PUT(FTRP(bp), PACK(size,0));
+	    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+	    PUT(FTRP(bp), PACK(size, PREV_ALLOC));
 	}
 
 	else if (!prev_alloc && next_alloc) {      /* Case 3 */
-        /* Selecting the seggregated list*/
-	    findList(GET_SIZE(HDRP(PREV_BLKP(bp))));
-	    joinTwoBlocks(bp,PREV);
-	    updateList();
+        /* Taking the prev block out of its seggregated list*/
+	    joinTwoBlocks(a,bp,PREV);
+	    STAT_INC(a, coalesces);
         /* Coalescing the prev block*/
 
 	    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-	    PUT(FTRP(bp), PACK(size, 0));
-	    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+	    PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+	    PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
 	    bp = PREV_BLKP(bp);
 	}
 
 	else {                                     /* Case 4 */
 
-        /* Selecting the seggregated list*/
-	    findList(GET_SIZE(HDRP(NEXT_BLKP(bp))));
-	    joinTwoBlocks(bp,NEXT);
-	    updateList();
-
-        /* Selecting the seggregated list*/
-	    findList(GET_SIZE(HDRP(PREV_BLKP(bp))));
-	    joinTwoBlocks(bp,PREV);
-	    updateList();
+        /* Taking both blocks out of their seggregated lists*/
+	    joinTwoBlocks(a,bp,NEXT);
+	    joinTwoBlocks(a,bp,PREV);
+	    STAT_ADD(a, coalesces, 2);
 
         /* Coalescing the prev and next block*/
-	    size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
+	    size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
 	    GET_SIZE(FTRP(NEXT_BLKP(bp)));
-	    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-	    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+	    PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+	    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, PREV_ALLOC));
 	    bp = PREV_BLKP(bp);
 	}
-        /* Selecting the seggregated list and moving to the top*/
-	findList(size);
-	movFreeBlock_top(bp);
-	updateList();
-
-	start = start1;
-
-	bucket_number = prevBucket;
+        /* Moving to the top of the seggregated list of the new size*/
+	movFreeBlock_top(a,bp);
 	return bp;
 }
 /* $end mmfree */
 
 /*
- *  * realloc- Naive implementation of realloc
+ *  * realloc- Resizes the block in place whenever possible. A shrink splits
+ *  off the tail when it is at least 16 bytes, a grow absorbs a free next 
+ *  block, and a block that ends the heap (or is followed by the last, free
+ *  block) extends the heap by the missing bytes only. Only otherwise is the
+ *  block moved by malloc, copy and free. Slab slots stay put while the new
+ *  size fits in the slot. With threads a block of another arena is always
+ *  moved to the arena of the thread
  */
 void *realloc(void *ptr, size_t size)
 {
-	size_t oldsize;
+	arena_t *a;
 	void *newptr;
 
-	/* If size == 0 then this is just free, and we return NULL. 
+	/* If size == 0 then this is just free, and we return NULL.
 	* */
-	if(size == 0) 
+	if(size == 0)
 	{
-		mm_free(ptr);
+		free(ptr);
 		return 0;
 	}
 
 	/* If oldptr is NULL, then this is just malloc. */
-	if(ptr == NULL) 
+	if(ptr == NULL)
 	{
 		return malloc(size);
 	}
 
-	newptr = malloc(size);
+#ifndef DRIVER
+	if (IS_MMAPPED(ptr))
+		return mmap_realloc(ptr, size);
+#endif
+	a = thread_arena();
+#ifdef MM_THREADS
+	if (ARENA_OF(ptr) != a)
+	{
+		size_t oldsize = IS_SLAB(ptr) ? RUN_OF(ptr)->size :
+			GET_SIZE(HDRP(ptr)) - WSIZE;
+
+		if ((newptr = malloc(size)) == NULL)
+			return 0;
+		memcpy(newptr, ptr, MIN(size, oldsize));
+		free(ptr);
+		return newptr;
+	}
+#endif
+	ARENA_LOCK(a);
+#ifdef MM_THREADS
+	drain_remote(a);
+#endif
+	newptr = arena_realloc(a, ptr, size);
+	ARENA_UNLOCK(a);
+	return newptr;
+}
+
+/*
+ *  arena_realloc - realloc of a block of the arena, which the caller has
+ *  locked
+ */
+static void *arena_realloc(arena_t *a, void *ptr, size_t size)
+{
+	size_t oldsize, asize, csize, nsize;
+	void *newptr;
+	char *next;
+
+	if (IS_SLAB(ptr)) 
+	{
+		oldsize = RUN_OF(ptr)->size;
+		if (size <= oldsize) 
+			return ptr;
+	}
+	else 
+	{
+		asize = ASIZE(size);
+		csize = GET_SIZE(HDRP(ptr));
+		next = NEXT_BLKP(ptr);
+		nsize = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+
+		/* Grow into the wilderness, extend_heap coalesces the new
+		 * space with a free next block so it starts at next */
+		if (csize + nsize < asize && 
+				GET_SIZE(HDRP(nsize ? NEXT_BLKP(next) : next)) == 0) 
+		{
+			if (extend_heap(a, MAX(asize - csize - nsize, 2*DSIZE)/
+						WSIZE) == NULL) 
+				return 0;
+			nsize = GET_SIZE(HDRP(next));
+		}
+
+		if (csize + nsize >= asize) 
+		{
+			/* Absorb the free next block */
+			if (nsize) 
+			{
+				joinTwoBlocks(a,ptr,NEXT);
+
+				csize += nsize;
+				PUT(HDRP(ptr), PACK(csize, 1 | 
+							GET_PREV_ALLOC(HDRP(ptr))));
+				SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+			}
+
+			/* Split off and free the tail */
+			if (csize - asize >= 2*DSIZE) 
+			{
+				STAT_INC(a, splits);
+				PUT(HDRP(ptr), PACK(asize, 1 |  
+							GET_PREV_ALLOC(HDRP(ptr))));
+				next = NEXT_BLKP(ptr);
+				PUT(HDRP(next), PACK(csize - asize, 1 | PREV_ALLOC));
+				block_free(a, next);
+			}
+			MARK_DIRTY(a, ptr);
+			return ptr;
+		}
+		oldsize = csize - WSIZE;
+	}
+
+	newptr = arena_malloc(a, size);
 
 		/* If realloc() fails the original block is left 
 		 * untouched  */
@@ -677,58 +1957,321 @@ void *realloc(void *ptr, size_t size)
 		return 0;
 	}
 
-	/* Copy the old data. */
-	oldsize = GET_SIZE(HDRP(ptr));
-	if(size < oldsize) oldsize = size;
-	    memcpy(newptr, ptr, oldsize);
+	/* Copy the old data. */
+	if(size < oldsize) oldsize = size;
+	    memcpy(newptr, ptr, oldsize);
+
+	    /* Free the old block. */
+	arena_free(a, ptr);
+	return newptr;
+}
+
+/*
+ * calloc - Allocate the block and set it to zero.
+ */
+void *calloc (size_t memb, size_t size)
+{
+	size_t bytes = memb * size;
+	void *newptr;
+
+	/* memb * size must not wrap around */
+	if (size != 0 && bytes / size != memb)
+		return NULL;
+
+	newptr = malloc(bytes);
+	if (newptr == NULL)
+		return NULL;
+#ifndef DRIVER
+	/* Fresh mappings are already zero */
+	if (IS_MMAPPED(newptr))
+		return newptr;
+#endif
+	memset(newptr, 0, bytes);
+
+	return newptr;
+}
+
+#ifndef DRIVER
+
+/*
+ * memalign - Allocate a block of size bytes aligned to align bytes (a 
+ * power of two). Alignments up to ALIGNMENT are what malloc gives anyway,
+ * larger ones are carved out of a free block by alloc_aligned
+ */
+void *memalign(size_t align, size_t size)
+{
+	arena_t *a;
+	void *bp;
+
+	if (align <= ALIGNMENT)
+		return malloc(size);
+	if (align & (align - 1))
+		return NULL;
+	if (lazy_init() == -1)
+		return NULL;
+
+	a = thread_arena();
+	ARENA_LOCK(a);
+#ifdef MM_THREADS
+	drain_remote(a);
+#endif
+	bp = alloc_aligned(a, size ? size : 1, align);
+	ARENA_UNLOCK(a);
+	return bp;
+}
+
+/*
+ * posix_memalign - memalign which reports errors instead of setting errno
+ */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+	void *bp;
+
+	if (align < sizeof(void *) || (align & (align - 1)))
+		return EINVAL;
+	if ((bp = memalign(align, size)) == NULL)
+		return ENOMEM;
+	*memptr = bp;
+	return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+	return memalign(align, size);
+}
+
+void *valloc(size_t size)
+{
+	return memalign(getpagesize(), size);
+}
+
+/*
+ * malloc_usable_size - bytes of payload in the block of bp, the slot size
+ * for a slab slot
+ */
+size_t malloc_usable_size(void *bp)
+{
+	if (bp == NULL)
+		return 0;
+	if (IS_MMAPPED(bp))
+		return MMAP_LEN(bp) - MMAP_HDR;
+	if (IS_SLAB(bp))
+		return RUN_OF(bp)->size;
+	return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+#endif
+
+/*
+ * mm_arena_create - a new region arena with chunks of chunk_size bytes 
+ * (REGION_CHUNK if 0), which only takes its first chunk on the first 
+ * mm_arena_alloc. Returns NULL if out of memory
+ */
+mm_arena_t *mm_arena_create(size_t chunk_size)
+{
+	mm_arena_t *r;
+
+	if (chunk_size == 0)
+		chunk_size = REGION_CHUNK;
+	if (chunk_size < 4 * REGION_HDR)
+		chunk_size = 4 * REGION_HDR;
+	if ((r = malloc(sizeof(mm_arena_t))) == NULL)
+		return NULL;
+	r->ptr = r->end = NULL;
+	r->first = r->cur = r->big = NULL;
+	r->chunk_size = ALIGN(chunk_size);
+	return r;
+}
+
+/*
+ * mm_arena_alloc - bumps the pointer of the current chunk by size bytes 
+ * (rounded up to ALIGNMENT), moving to the next chunk, taken with malloc
+ * if the arena has no more, when it does not fit. A request above 
+ * REGION_BIG gets a chunk of its own. Returns NULL for size 0 or if out 
+ * of memory
+ */
+void *mm_arena_alloc(mm_arena_t *r, size_t size)
+{
+	size_t asize = ALIGN(size);
+	region_chunk *c;
+	char *bp;
+
+	if (size == 0 || asize < size)
+		return NULL;
+	if (asize <= (size_t)(r->end - r->ptr)) {
+		bp = r->ptr;
+		r->ptr += asize;
+		return bp;
+	}
+
+	if (asize > REGION_BIG(r)) {
+		if (asize > (size_t)-1 - REGION_HDR ||
+		    (c = malloc(REGION_HDR + asize)) == NULL)
+			return NULL;
+		c->next = r->big;
+		r->big = c;
+		return (char *)c + REGION_HDR;
+	}
+
+	/* The rest of the current chunk is left, all chunks have the same
+	 * size so the next one always fits */
+	if (r->cur != NULL && r->cur->next != NULL)
+		c = r->cur->next;
+	else {
+		if ((c = malloc(r->chunk_size)) == NULL)
+			return NULL;
+		c->next = NULL;
+		if (r->cur != NULL)
+			r->cur->next = c;
+		else
+			r->first = c;
+	}
+	r->cur = c;
+	bp = (char *)c + REGION_HDR;
+	r->ptr = bp + asize;
+	r->end = (char *)c + r->chunk_size;
+	return bp;
+}
+
+/*
+ * mm_arena_reset - drops every block of the arena at once : the bump 
+ * pointer goes back to the start of the first chunk, the chunks are kept.
+ * Constant time, but for the chunks of big requests which are freed
+ */
+void mm_arena_reset(mm_arena_t *r)
+{
+	region_chunk *c, *next;
+
+	for (c = r->big; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	r->big = NULL;
+	r->cur = r->first;
+	if (r->first != NULL) {
+		r->ptr = (char *)r->first + REGION_HDR;
+		r->end = (char *)r->first + r->chunk_size;
+	}
+}
+
+/*
+ * mm_arena_destroy - frees every chunk of the arena and the arena itself
+ */
+void mm_arena_destroy(mm_arena_t *r)
+{
+	region_chunk *c, *next;
+
+	if (r == NULL)
+		return;
+	mm_arena_reset(r);
+	for (c = r->first; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(r);
+}
+
+#ifndef DRIVER
 
-	    /* Free the old block. */
-	mm_free(ptr);
-	return newptr;
+/*
+ * mmap_malloc - maps whole pages for the block and its length word
+ */
+static void *mmap_malloc(size_t size)
+{
+	size_t page = mem_pagesize();
+	size_t len = (size + MMAP_HDR + page - 1) & ~(page - 1);
+	char *m;
+
+	if (len < size)
+		return NULL; /* size is too large to round up */
+	m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (m == MAP_FAILED)
+		return NULL;
+	m += MMAP_HDR;
+	MMAP_LEN(m) = len;
+	return m;
 }
 
 /*
- * calloc - Allocate the block and set it to zero.
+ * mmap_free - gives the mapping of the block back to the system
  */
-void *calloc (size_t memb, size_t size)
+static void mmap_free(void *bp)
 {
-	size_t bytes = memb * size;
-	void *newptr;
+	munmap((char *)bp - MMAP_HDR, MMAP_LEN(bp));
+}
 
-	newptr = malloc(bytes);
-	memset(newptr, 0, bytes);
+/*
+ * mmap_realloc - a block staying huge is resized with mremap, which moves
+ * pages instead of copying them; one becoming small moves to the heap
+ */
+static void *mmap_realloc(void *bp, size_t size)
+{
+	size_t page = mem_pagesize();
+	size_t len = (size + MMAP_HDR + page - 1) & ~(page - 1);
+	char *m;
+	void *newptr;
 
-	return newptr;
+	if (size < MMAP_THRESHOLD)
+	{
+		if ((newptr = malloc(size)) == NULL)
+			return NULL;
+		memcpy(newptr, bp, size);
+		mmap_free(bp);
+		return newptr;
+	}
+	if (len < size)
+		return NULL;
+	if (len == MMAP_LEN(bp))
+		return bp;
+
+	m = mremap((char *)bp - MMAP_HDR, MMAP_LEN(bp), len, MREMAP_MAYMOVE);
+	if (m == MAP_FAILED)
+		return NULL;
+	m += MMAP_HDR;
+	MMAP_LEN(m) = len;
+	return m;
 }
+#endif
 
 
 /*
  * extend_heap : extends the heap by number of words 
  *
- * parameter : words
+ * parameter : arena, words
  */
 
-static void *extend_heap(size_t words) 
+static void *extend_heap(arena_t *a, size_t words) 
 {
 	char *bp;
 	size_t size;
 
 	/* Allocate an even number of words to maintain alignment */
 	size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
-	if ((long)(bp = mem_sbrk(size)) == -1)  
+	if ((long)(bp = arena_sbrk(a, size)) == -1)  
 		    return NULL;                               
+	STAT_INC(a, extends);
+	STAT_ADD(a, extend_bytes, size);
+	if (a->trimmed)
+	{
+		a->trimmed = 0;
+		if (a->trim_threshold < TRIM_MAX)
+			a->trim_threshold *= 2;
+	}
 
 	    /* Initialize free block header/footer and the 
-	     * epilogue header */
-	PUT(HDRP(bp), PACK(size, 0));         /* Free block header */  
-	PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */ 
+	     * epilogue header, the old epilogue knows if the last
+	     * block is allocated */
+	size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	PUT(HDRP(bp), PACK(size, prev_alloc)); /* Free block header */  
+	PUT(FTRP(bp), PACK(size, prev_alloc)); /* Free block footer */ 
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
 	WRITESUCCESSOR(bp,0);
 	WRITEPREDESSOR(bp,0);
 
 	/* Coalesce if the previous block was 
 	* free */
-	return coalesce(bp);                                          
+	return coalesce(a, bp);                                          
 }
 /* $end mmextendheap */
 
@@ -737,72 +2280,296 @@ static void *extend_heap(size_t words)
  * i//f actual size of block is greater than 16 bytes. Places removes the block 
  * from the seggregated list and joins other two blocks
  *
- * parameter : block pointer, required size
+ * parameter : arena, block pointer, required size
  */
-static void place(void *bp, size_t asize)
+static void place(arena_t *a, void *bp, size_t asize)
              /* $end mmplace-proto */
 {
             size_t csize = GET_SIZE(HDRP(bp));   
-            findList(csize);
-            joinTwoBlocks(bp,CURR);
-            updateList();
+            joinTwoBlocks(a,bp,CURR);
+            MARK_DIRTY(a, bp);
       /*      if ((NEXTFREE(bp) == NULL) && (PREVFREE(bp) == NULL)) 
             {
                     start = 0;
             } */
             if ((csize - asize) >= (2*DSIZE)) { 
                     
-                    PUT(HDRP(bp), PACK(asize, 1));
-                    PUT(FTRP(bp), PACK(asize, 1));
+                    STAT_INC(a, splits);
+                    PUT(HDRP(bp), PACK(asize, 1 | PREV_ALLOC));
                     bp = NEXT_BLKP(bp);
-                    PUT(HDRP(bp), PACK(csize-asize, 0));
-                    PUT(FTRP(bp), PACK(csize-asize, 0));
-                    char * start1 = start;
-                    int prevBucket = bucket_number;
-                    findList(csize-asize);
-                    movFreeBlock_top(bp);
-                    updateList();
-                    start = start1;
-                    bucket_number = prevBucket;
+                    PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
+                    PUT(FTRP(bp), PACK(csize-asize, PREV_ALLOC));
+                    movFreeBlock_top(a,bp);
 
             }
             else { 
-                    PUT(HDRP(bp), PACK(csize, 1));
-                    PUT(FTRP(bp), PACK(csize, 1));
-
+                    asize = csize;
+                    PUT(HDRP(bp), PACK(csize, 1 | PREV_ALLOC));
+                    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
             }
-
+            STAT_INC(a, allocs[BUCKET_INDEX(asize)]);
+            STAT_ADD(a, allocated, asize);
 }
 
 /*
- * find_fit : searches the free list for first fit and returns
- * the pointer to the block
+ * find_fit : searches the bucket of asize for first fit (sizes within a 
+ * bucket vary). Otherwise the first non-empty larger bucket is found with
+ * one bit scan of bucket_map, and as every block in it is larger than
+ * asize its head is returned. The last bucket is searched for the best fit
+ * in its tree instead
  *
- * parameter : actual size of block
+ * parameter : arena, actual size of block
  */
 
-static void *find_fit(size_t asize)
+static void *find_fit(arena_t *a, size_t asize)
 {
-	/* First fit search */
-	void *bp;
-	//mm_checkheap(420);
-	char * start1;
-	int i = bucket_number ;
-	for ( start1 = GETPTR(BUCKET_ELEM(bucket_number)); i < BUCKET; 
-                    start1=GETPTR(BUCKET_ELEM(i)))
+	char *bp;
+	unsigned int i = BUCKET_INDEX(asize);
+	unsigned long long larger;
+
+	STAT_INC(a, fit_searches);
+	if (i == LAST_BUCKET) 
+	{
+		STAT_INC(a, tree_fits);
+		if ((bp = tree_fit(GETPTR(BUCKET_ELEM(a,i)), asize)) == NULL)
+			STAT_INC(a, fit_misses);
+		return bp;
+	}
+
+	for (bp = GETPTR(BUCKET_ELEM(a,i)); bp != NULL; bp = NEXTFREE(bp)) 
+	{
+		STAT_INC(a, fit_probes);
+		if (asize <= GET_SIZE(HDRP(bp))) 
+			return bp;
+	}
+
+	/* Buckets above i */
+	larger = a->bucket_map & ~((2ULL << i) - 1);
+	if (larger == 0) 
 	{
-	for (bp = start1; bp != NULL ; bp = (void *) NEXTFREE(bp)) 
+		STAT_INC(a, fit_misses);
+		return NULL; /* No fit */
+	}
+
+	i = __builtin_ctzll(larger);
+	bp = GETPTR(BUCKET_ELEM(a,i));
+	if (i == LAST_BUCKET) 
+	{
+		STAT_INC(a, tree_fits);
+		bp = tree_fit(bp, asize);
+	}
+	return bp;
+}
+
+
+/*
+ * find_aligned_fit : walks the non-empty buckets from the bucket of asize
+ * up (skipping empty ones with bucket_map) and returns the first free 
+ * block in which the aligned payload, moved up by align when the front 
+ * part would be smaller than a minimum block, still leaves asize bytes.
+ * In the tree the best fit with room for any alignment is taken
+ *
+ * parameters : arena, asize (block size), align (alignment)
+ */
+
+static void *find_aligned_fit(arena_t *a, size_t asize, size_t align)
+{
+	unsigned long long buckets = a->bucket_map & ~((1ULL <<  
+				BUCKET_INDEX(asize)) - 1);
+	char *bp, *ap;
+	unsigned int i;
+
+	while (buckets) 
 	{
-		if (asize <= GET_SIZE(HDRP(bp))) {
-			    return bp;
+		i = __builtin_ctzll(buckets);
+		buckets &= buckets - 1;
+		if (i == LAST_BUCKET) 
+			return tree_fit(GETPTR(BUCKET_ELEM(a,i)),
+					asize + align + 2*DSIZE);
+		for (bp = GETPTR(BUCKET_ELEM(a,i)); bp != NULL; bp = NEXTFREE(bp)) 
+		{
+			ap = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+			if (ap != bp && ap - bp < 2*DSIZE) 
+				ap += align;
+			if (ap + asize <= bp + GET_SIZE(HDRP(bp))) 
+				return bp;
 		}
+	}
+	return NULL;
+}
+
+/*
+ * alloc_aligned : allocates a block with payload of size bytes aligned to
+ * align bytes. The fit has room for the aligned block with the front part 
+ * either empty or a valid free block; the tail is split off when it is at
+ * least 16 bytes
+ *
+ * parameters : arena, size (payload bytes), align (alignment)
+ */
+
+static void *alloc_aligned(arena_t *a, size_t size, size_t align) 
+{
+	size_t asize = ASIZE(size);
+	size_t csize, front;
+	char *bp, *ap;
+
+	if ((bp = find_aligned_fit(a, asize, align)) == NULL && 
+			a->quick_bytes > 0) 
+	{
+		drain_quick(a);
+		bp = find_aligned_fit(a, asize, align);
+	}
+	if (bp == NULL) 
+	{
+		/* 
+		 * Extend the heap just enough for the aligned block : the new
+		 * block starts at the last block if it is free (coalesce) or
+		 * else at the old epilogue. A free last block may already be
+		 * large enough for part of the block
+		 */
+		char *top = a->brk;
+		size_t last = GET_PREV_ALLOC(top - WSIZE) ? 0 : 
+			GET_SIZE(top - DSIZE);
+		bp = top - last;
+		ap = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+		if (ap != bp && ap - bp < 2*DSIZE) 
+			ap += align;
+		if (ap + asize > top && 
+				extend_heap(a, (ap + asize - top)/WSIZE) == NULL) 
+			return NULL;
+	}
+
+	/* Take the fit out of its seggregated list */
+	csize = GET_SIZE(HDRP(bp));
+	joinTwoBlocks(a,bp,CURR);
+
+	ap = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+	if (ap != bp && ap - bp < 2*DSIZE) 
+		ap += align;
+	front = ap - bp;
+	if (csize - front - asize < 2*DSIZE) 
+		asize = csize - front;
+
+	PUT(HDRP(ap), PACK(asize, 1 | (front ? 0 : PREV_ALLOC)));
+	MARK_DIRTY(a, ap);
+
+	/* Free space behind and in front of the aligned block */
+	if (csize - front - asize) 
+	{
+		char * tp = NEXT_BLKP(ap);
+		STAT_INC(a, splits);
+		PUT(HDRP(tp), PACK(csize - front - asize, PREV_ALLOC));
+		PUT(FTRP(tp), PACK(csize - front - asize, PREV_ALLOC));
+		movFreeBlock_top(a,tp);
+	}
+	else 
+	{
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(ap)));
+	}
+	if (front) 
+	{
+		STAT_INC(a, splits);
+		PUT(HDRP(bp), PACK(front, PREV_ALLOC));
+		PUT(FTRP(bp), PACK(front, PREV_ALLOC));
+		movFreeBlock_top(a,bp);
+	}
+	STAT_INC(a, allocs[BUCKET_INDEX(asize)]);
+	STAT_ADD(a, requested, size);
+	STAT_ADD(a, allocated, asize);
+	return ap;
+}
 
+/*
+ * slab_malloc : returns the first free slot (lowest clear bit of the used
+ * bitmap) of the first partial run of the class of size. A new run is 
+ * carved out of the heap at RUN_SIZE alignment when the class has no 
+ * partial run, and a run with no free slot left leaves the partial list
+ *
+ * parameters : arena, size (request size, at most SLAB_MAX)
+ */
+
+static void *slab_malloc(arena_t *a, size_t size)
+{
+	unsigned int cls = SLAB_CLASS(size);
+	slab_run * run = a->slab_partial[cls];
+	unsigned int w, slot;
+
+	if (run == NULL) 
+	{
+		if ((run = alloc_aligned(a, RUN_PAYLOAD, RUN_SIZE)) == NULL) 
+			return NULL;
+		memset(run, 0, sizeof(slab_run));
+		run->size = SLAB_SIZE(cls);
+		run->cls = cls;
+		run->nslots = MIN((RUN_PAYLOAD - sizeof(slab_run)) / run->size,
+				RUN_SLOTS);
+		run->nfree = run->nslots;
+		a->slab_partial[cls] = run;
+		SET_SLAB(run);
+#ifndef MM_THREADS
+		slab_map_hi = MAX(slab_map_hi, (RUN_BIT(run) >> 6) + 1);
+#endif
 	}
-	i++;
+
+	for (w = 0; !(~run->used[w]); w++)
+		;
+	slot = w * 64 + __builtin_ctzll(~run->used[w]);
+	run->used[w] |= 1ULL << (slot & 63);
+	MARK_DIRTY(a, run);
+	STAT_INC(a, slab_allocs[cls]);
+	STAT_ADD(a, requested, size);
+	STAT_ADD(a, allocated, run->size);
+
+	if (--run->nfree == 0) 
+	{
+		a->slab_partial[cls] = run->next;
+		if (run->next != NULL) 
+			run->next->prev = NULL;
+		run->next = NULL;
 	}
-	return NULL; /* No fit */
+	return (char *)run + sizeof(slab_run) + slot * run->size;
 }
 
+/*
+ * slab_free : clears the used bit of the slot of bp, putting a full run 
+ * back on the partial list of its class. A run which becomes empty is 
+ * freed as a regular block unless it is the only partial run of its class
+ * (so that malloc/free of one object does not create a run each time)
+ *
+ * parameters : arena, bp (pointer to the slot)
+ */
+
+static void slab_free(arena_t *a, void *bp) 
+{
+	slab_run * run = RUN_OF(bp);
+	unsigned int slot = ((char *)bp - (char *)run - sizeof(slab_run)) / 
+		run->size;
+
+	run->used[slot >> 6] &= ~(1ULL << (slot & 63));
+	MARK_DIRTY(a, run);
+	STAT_INC(a, slab_frees[run->cls]);
+	if (run->nfree++ == 0) 
+	{
+		run->prev = NULL;
+		run->next = a->slab_partial[run->cls];
+		if (run->next != NULL) 
+			run->next->prev = run;
+		a->slab_partial[run->cls] = run;
+	}
+
+	if (run->nfree == run->nslots && 
+			(run->next != NULL || run->prev != NULL)) 
+	{
+		if (run->prev != NULL) 
+			run->prev->next = run->next;
+		else 
+			a->slab_partial[run->cls] = run->next;
+		if (run->next != NULL) 
+			run->next->prev = run->prev;
+		CLEAR_SLAB(run);
+		block_free(a, run);
+	}
+}
 
 /*
  * checkblock : Check block's alignment (8-bit)
@@ -810,38 +2577,184 @@ static void *find_fit(size_t asize)
 
 static void checkblock(void *bp) 
 {
-	if ((size_t)bp % 8)
+	if ((size_t)bp % ALIGNMENT)
 		printf("Error: %p is not doubleword aligned\n", bp);
-	if (GET(HDRP(bp)) != GET(FTRP(bp)))
-		printf("Error: header does not match footer %d and %d\n",GET(HDRP(bp)),
-                        GET(FTRP(bp)));
+	if (!GET_ALLOC(HDRP(bp)) && GET(HDRP(bp)) != GET(FTRP(bp)))
+		printf("Error: header does not match footer %lu and %lu\n",
+                        (unsigned long)GET(HDRP(bp)),
+                        (unsigned long)GET(FTRP(bp)));
 }
 
 /* 
  *  * checkheap - Minimal check of the heap for consistency 
  *   */
-void mm_checkheap(int verbose) 
+void mm_checkheap(int verbose)
+{
+            unsigned int i;
+
+            for (i = 0 ; i < MM_ARENAS; i++)
+            {
+                    checkarena(&arenas[i], verbose);
+            }
+}
+
+/*
+ * mm_checkheap_incr - checks the blocks changed since its last call and 
+ * one seggregated list per arena, the whole heap on its first call and 
+ * whenever too many blocks changed
+ */
+void mm_checkheap_incr(int verbose)
+{
+	unsigned int i, j;
+	arena_t *a;
+
+	check_incr = 1;
+	for (i = 0; i < MM_ARENAS; i++)
+	{
+		a = &arenas[i];
+		if (a->heap_listp == NULL)
+			continue;
+		if (a->dirty_all)
+			checkarena(a, verbose);
+		else
+		{
+			for (j = 0; j < a->ndirty; j++)
+			{
+				if (verbose)
+					checkblock(a->dirty[j]);
+				checkdirty(a, a->dirty[j]);
+			}
+			checklist(a, a->check_list);
+			a->check_list = (a->check_list + 1) % BUCKET;
+		}
+		a->ndirty = 0;
+		a->dirty_all = 0;
+	}
+}
+
+#ifdef MM_STATS
+
+/*
+ * mm_stats - sums the counters of the arenas into stats and walks their 
+ * heaps for the free blocks
+ */
+void mm_stats(mm_stats_t *stats)
+{
+	unsigned int i, j;
+	arena_t *a;
+	char *bp;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < MM_ARENAS; i++)
+	{
+		a = &arenas[i];
+		if (a->heap_listp == NULL)
+			continue;
+		ARENA_LOCK(a);
+		for (j = 0; j < MM_STATS_CLASSES; j++)
+		{
+			stats->allocs[j] += a->stats.allocs[j];
+			stats->frees[j] += a->stats.frees[j];
+			stats->slab_allocs[j] += a->stats.slab_allocs[j];
+			stats->slab_frees[j] += a->stats.slab_frees[j];
+		}
+		stats->splits += a->stats.splits;
+		stats->coalesces += a->stats.coalesces;
+		stats->fit_searches += a->stats.fit_searches;
+		stats->fit_probes += a->stats.fit_probes;
+		stats->fit_misses += a->stats.fit_misses;
+		stats->tree_fits += a->stats.tree_fits;
+		stats->extends += a->stats.extends;
+		stats->extend_bytes += a->stats.extend_bytes;
+		stats->trims += a->stats.trims;
+		stats->quick_frees += a->stats.quick_frees;
+		stats->quick_allocs += a->stats.quick_allocs;
+		stats->quick_drains += a->stats.quick_drains;
+		stats->requested += a->stats.requested;
+		stats->allocated += a->stats.allocated;
+
+		stats->heap += a->brk - a->lo;
+		for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; 
+				bp = NEXT_BLKP(bp))
+		{
+			if (GET_ALLOC(HDRP(bp)))
+				continue;
+			stats->free_bytes += GET_SIZE(HDRP(bp));
+			stats->largest_free = MAX(stats->largest_free, 
+					GET_SIZE(HDRP(bp)));
+			stats->free_blocks++;
+		}
+		ARENA_UNLOCK(a);
+	}
+}
+
+/*
+ * mm_heapmap - writes every block of the heaps to fp, one per line : its
+ * offset in the arena, size, kind (a allocated, f free, s slab run) and
+ * class (seggregated list bucket, or slab class followed by the used and
+ * total slots of the run)
+ */
+void mm_heapmap(FILE *fp)
+{
+	unsigned int i;
+	arena_t *a;
+	slab_run *run;
+	char *bp;
+	size_t size;
+
+	for (i = 0; i < MM_ARENAS; i++)
+	{
+		a = &arenas[i];
+		if (a->heap_listp == NULL)
+			continue;
+		ARENA_LOCK(a);
+		fprintf(fp, "arena %u %lu\n", i, (unsigned long)(a->brk - a->lo));
+		for (bp = NEXT_BLKP(a->heap_listp); 
+				(size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp))
+		{
+			fprintf(fp, "%lu %lu ", (unsigned long)(bp - a->lo),
+					(unsigned long)size);
+			if (!GET_ALLOC(HDRP(bp)))
+				fprintf(fp, "f %u\n", (unsigned int)BUCKET_INDEX(size));
+			else if (IS_SLAB(bp) && (char *)RUN_OF(bp) == bp)
+			{
+				run = RUN_OF(bp);
+				fprintf(fp, "s %u %u %u\n", run->cls, 
+						run->nslots - run->nfree, run->nslots);
+			}
+			else
+				fprintf(fp, "a %u\n", (unsigned int)BUCKET_INDEX(size));
+		}
+		ARENA_UNLOCK(a);
+	}
+}
+#endif
+
+/*
+ * checkarena - checks the heap of one arena, its seggregated lists, tree
+ * and slab runs
+ */
+static void checkarena(arena_t *a, int verbose)
 {
-            char *bp = heap_listp;
+            char *bp = a->heap_listp;
             //int i = 0 ;
             //char * temp = start;
 /*1.  Checking epilogue and prologue blocks */
 
-            if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || 
-                            !GET_ALLOC(HDRP(heap_listp)))
+            if ((GET_SIZE(HDRP(a->heap_listp)) != DSIZE) || 
+                            !GET_ALLOC(HDRP(a->heap_listp)))
                     printf("Bad prologue header\n");
 
-            if (verbose)
-                for (bp=heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
-                {
-                }
-                if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
-                        printf("Bad epilogue header\n");
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            {
+            }
+            if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+                    printf("Bad epilogue header\n");
 
 /*2. Checking block's alignment */
-                    checkblock(heap_listp);
+                    checkblock(a->heap_listp);
 
-            for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) 
+            for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) 
             {
 
                     if (verbose)
@@ -850,25 +2763,34 @@ void mm_checkheap(int verbose)
 
 
 /* 3. Checking Heap boundaries */
-            if (bucket_ptr != mem_heap_lo()) 
+            if (a->heap_listp != a->lo + 2*WSIZE) 
             {
                     printf("Bad starting memory boundary\n");
                     exit(-1);
             }
                                           
-            for (bp=heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
             {
             }
-            if (bp != mem_heap_hi() + 1) 
+            if (bp != a->brk) 
             {
                     printf("Bad ending memory boundary\n");
                     exit(-1);
             }
 
-/* 4. Check each block's header and footer consistency */
+/* 4. Check each free block's header and footer consistency and every 
+ * block's PREV_ALLOC bit against the previous block */
 
-            for (bp=heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
             {
+                    if (!GET_ALLOC(HDRP(bp)) != 
+                                    !GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)))) { 
+                            printf("Prev alloc bit is wrong in block \
+                                            after %p\n",bp);
+                            exit(-1);
+                    }
+                    if (GET_ALLOC(HDRP(bp))) 
+                            continue;
                     if (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))) { 
                             printf("Size is different in header \
                                             and footer of block %p\n",bp);
@@ -887,7 +2809,7 @@ void mm_checkheap(int verbose)
             }
 
 /* 5. No two consecutive free blocks are together in the heap*/
-            for (bp=heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
             {
                     if (!GET_ALLOC(HDRP(bp)) && 
                                     !GET_ALLOC(HDRP(NEXT_BLKP(bp)))) 
@@ -898,17 +2820,23 @@ void mm_checkheap(int verbose)
                     
             }
 /* 6. Checking if the pointers are consistent in the seggregated list and free 
- * list pointers are in the range between mem_heap_lo & mem_heap_high */
+ * list pointers are in the range of the arena */
             char * start1 = NULL;
             int i = 0 ;
             char * temp1;
-            for (start1=GETPTR(BUCKET_ELEM(i));i < BUCKET; 
-                            start1=GETPTR(BUCKET_ELEM(i)))
+            for (start1=GETPTR(BUCKET_ELEM(a,i));i < BUCKET; 
+                            start1=GETPTR(BUCKET_ELEM(a,i)))
             {
+                if ((start1 != NULL) != ((a->bucket_map >> i) & 1)) 
+                {
+                        printf("Bucket map does not match list %d\n",i);
+                        exit(-1);
+                }
+                if (i == LAST_BUCKET) 
+                        break;
                 for(temp1 = start1;temp1!=NULL;temp1 = NEXTFREE(temp1)) 
                 {
-                       if(!((void*)temp1 < (void*)mem_heap_hi()) && 
-                                       !((void*)temp1>(void*) mem_heap_lo())) 
+                       if(!(temp1 < a->brk) && !(temp1 > a->lo)) 
                        {
                                printf("Free list pointers are out \
                                                of range %p\n",temp1);
@@ -931,8 +2859,8 @@ void mm_checkheap(int verbose)
  */
             int countSeg = 0 ;
             int countImp = 0 ;
-            for (start1=GETPTR(BUCKET_ELEM(i));i < BUCKET; 
-                            start1=GETPTR(BUCKET_ELEM(i)))
+            for (start1=GETPTR(BUCKET_ELEM(a,i));i < BUCKET; 
+                            start1=GETPTR(BUCKET_ELEM(a,i)))
             {
                 for(temp1 = start1;temp1!=NULL;temp1 = NEXTFREE(temp1)) 
                 {
@@ -941,7 +2869,7 @@ void mm_checkheap(int verbose)
                 i++;
             }
 
-            for (bp=heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
             {
                 countImp++;
 
@@ -951,13 +2879,12 @@ void mm_checkheap(int verbose)
 /* 8. checking if the bucket ranges are in the same list */
             i = 0 ;
             int bucketIndex ;
-           for (start1=GETPTR(BUCKET_ELEM(i));i < BUCKET; 
-                            start1=GETPTR(BUCKET_ELEM(i)))
+           for (start1=GETPTR(BUCKET_ELEM(a,i));i < LAST_BUCKET; 
+                            start1=GETPTR(BUCKET_ELEM(a,i)))
             {
                 for(temp1 = start1;temp1!=NULL;temp1 = NEXTFREE(temp1)) 
                 {
-                        findList(GET_SIZE(HDRP(temp1)));
-                        bucketIndex = bucket_number;
+                        bucketIndex = BUCKET_INDEX(GET_SIZE(HDRP(temp1)));
                         if(bucketIndex != i ) 
                         {
                                 printf("Bucket size not in proper list\
@@ -967,5 +2894,266 @@ void mm_checkheap(int verbose)
                 }
                 i++;
             } 
+
+/* 9. Checking the large block tree holds every free block of its bucket */
+            countSeg = checktree(a, GETPTR(BUCKET_ELEM(a,LAST_BUCKET)), 
+                            NULL, NULL);
+            countImp = 0;
+            for (bp=a->heap_listp; GET_SIZE(HDRP(bp))> 0; bp = NEXT_BLKP(bp)) 
+            {
+                if (!GET_ALLOC(HDRP(bp)) && 
+                                BUCKET_INDEX(GET_SIZE(HDRP(bp))) == LAST_BUCKET) 
+                        countImp++;
+            }
+            if (countSeg != countImp) 
+            {
+                    printf("Tree has %d blocks, heap has %d\n",countSeg,
+                                    countImp);
+                    exit(-1);
+            }
+
+/* 10. Checking slab runs in the partial lists */
+            for (i = 0 ; i < SLAB_CLASSES; i++) 
+            {
+                slab_run * run;
+                for (run = a->slab_partial[i]; run != NULL; run = run->next) 
+                {
+                        if (!IS_SLAB(run) || run->cls != i || 
+                                        run->nfree == 0 || 
+                                        run->nfree > run->nslots || 
+                                        !GET_ALLOC(HDRP(run))) 
+                        {
+                                printf("Bad slab run %p in class %d\n",
+                                                run,i);
+                                exit(-1);
+                        }
+                        if (run->next != NULL && run->next->prev != run) 
+                        {
+                                printf("Slab run links are not matching %p\n",
+                                                run);
+                                exit(-1);
+                        }
+                }
+            }
+
+/* 11. Checking the quick lists : allocated blocks of their list size */
+            size_t quick_bytes = 0;
+            for (i = 0 ; i < QUICK_LISTS; i++) 
+            {
+                for (bp = a->quick[i]; bp != NULL; bp = *(char **)bp) 
+                {
+                        if (bp < a->lo || bp >= a->brk || 
+                                        !GET_ALLOC(HDRP(bp)) || 
+                                        GET_SIZE(HDRP(bp)) != (size_t)i * DSIZE) 
+                        {
+                                printf("Bad block %p in quick list %d\n",
+                                                bp,i);
+                                exit(-1);
+                        }
+                        quick_bytes += GET_SIZE(HDRP(bp));
+                }
+            }
+            if (quick_bytes != a->quick_bytes) 
+            {
+                    printf("Quick lists hold %lu bytes, not %lu\n",
+                                    (unsigned long)quick_bytes,
+                                    (unsigned long)a->quick_bytes);
+                    exit(-1);
+            }
+}
+
+/*
+ * checktree : recursively checks that every node lies between the bounds
+ * its ancestors set in tree order : the nodes of a left subtree come 
+ * before the parent, those of a right subtree after it, at any depth. 
+ * As the order is strict this also rules out cycles in the child links
+ *
+ * parameter : arena, root of the tree, lower and upper bound (or NULL)
+ */
+
+static int checktree(arena_t *a, char *t, char *lo, char *hi) 
+{
+    if (t == NULL) 
+        return 0;
+    if (t < a->lo || t >= a->brk || (size_t)t % ALIGNMENT || 
+                    GET_ALLOC(HDRP(t)) || 
+                    BUCKET_INDEX(GET_SIZE(HDRP(t))) != LAST_BUCKET) 
+    {
+        printf("Bad block %p in the large block tree\n",t);
+        exit(-1);
+    }
+    if ((lo != NULL && !TREE_LESS(GET_SIZE(HDRP(lo)), lo, 
+                                    GET_SIZE(HDRP(t)), t)) || 
+                    (hi != NULL && !TREE_LESS(GET_SIZE(HDRP(t)), t, 
+                                    GET_SIZE(HDRP(hi)), hi))) 
+    {
+        printf("Large block tree is out of order at %p\n",t);
+        exit(-1);
+    }
+    return 1 + checktree(a, LEFT(t), lo, t) + checktree(a, RIGHT(t), t, hi);
+}
+
+/*
+ * mark_dirty : appends the block to the dirty set (a block changed twice
+ * in a row is only kept once), or gives up on it when it is full
+ */
+
+static void mark_dirty(arena_t *a, void *bp)
+{
+	if (a->dirty_all || (a->ndirty > 0 && a->dirty[a->ndirty - 1] == bp))
+		return;
+	if (a->ndirty == DIRTY_MAX)
+		a->dirty_all = 1;
+	else
+		a->dirty[a->ndirty++] = bp;
+}
+
+/*
+ * forget_dirty : removes every entry of the block from the dirty set, the
+ * last entry takes the place of a removed one
+ */
+
+static void forget_dirty(arena_t *a, void *bp)
+{
+	unsigned int i = 0;
+
+	while (i < a->ndirty)
+	{
+		if (a->dirty[i] == bp)
+			a->dirty[i] = a->dirty[--a->ndirty];
+		else
+			i++;
+	}
+}
+
+/*
+ * checkdirty : the checks of checkarena restricted to one block. A free 
+ * block must have allocated neighbours, matching header and footer and 
+ * be linked from its list (found in the tree by its key), an allocated one
+ * must agree with the PREV_ALLOC bit of the next block and a slab run with
+ * the bitmap of its slots
+ */
+
+static void checkdirty(arena_t *a, char *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+	unsigned int index = BUCKET_INDEX(size);
+	char *next, *prev, *t;
+
+	if (bp <= a->heap_listp || bp >= a->brk || (size_t)bp % ALIGNMENT || 
+			size < 2*DSIZE || size % DSIZE || bp + size > a->brk)
+	{
+		printf("Bad block %p in the dirty set\n",bp);
+		exit(-1);
+	}
+	next = NEXT_BLKP(bp);
+	if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(next)))
+	{
+		printf("Prev alloc bit is wrong in block after %p\n",bp);
+		exit(-1);
+	}
+	if (!GET_PREV_ALLOC(HDRP(bp)))
+	{
+		prev = PREV_BLKP(bp);
+		if (prev <= a->heap_listp || GET_ALLOC(HDRP(prev)) || 
+				GET(HDRP(prev)) != GET(FTRP(prev)) || 
+				NEXT_BLKP(prev) != bp)
+		{
+			printf("Bad free block before %p\n",bp);
+			exit(-1);
+		}
+	}
+
+	if (GET_ALLOC(HDRP(bp)))
+	{
+		if (IS_SLAB(bp) && (char *)RUN_OF(bp) == bp)
+		{
+			slab_run * run = RUN_OF(bp);
+			unsigned int w, used = 0;
+
+			for (w = 0; w < RUN_SLOTS / 64; w++)
+				used += __builtin_popcountll(run->used[w]);
+			if (run->cls >= SLAB_CLASSES || 
+					run->nslots > RUN_SLOTS || 
+					used + run->nfree != run->nslots)
+			{
+				printf("Bad slab run %p\n",bp);
+				exit(-1);
+			}
+		}
+		return;
+	}
+
+	if (GET(HDRP(bp)) != GET(FTRP(bp)))
+	{
+		printf("Fields are different in header and footer of block %p\n",
+				bp);
+		exit(-1);
+	}
+	if (!GET_PREV_ALLOC(HDRP(bp)) || !GET_ALLOC(HDRP(next)))
+	{
+		printf("Two free blocks are together %p\n",bp);
+		exit(-1);
+	}
+	if (!((a->bucket_map >> index) & 1))
+	{
+		printf("Bucket map does not match list %u\n",index);
+		exit(-1);
+	}
+	if (index == LAST_BUCKET)
+	{
+		for (t = GETPTR(BUCKET_ELEM(a,index)); t != NULL && t != bp; )
+			t = TREE_LESS(size, bp, GET_SIZE(HDRP(t)), t) ? 
+				LEFT(t) : RIGHT(t);
+	}
+	else if (PREVFREE(bp) != NULL)
+		t = NEXTFREE(PREVFREE(bp));
+	else
+		t = GETPTR(BUCKET_ELEM(a,index));
+	if (t != bp || (index != LAST_BUCKET && NEXTFREE(bp) != NULL && 
+				PREVFREE(NEXTFREE(bp)) != bp))
+	{
+		printf("Free block %p is not linked in list %u\n",bp,index);
+		exit(-1);
+	}
 }
 
+/*
+ * checklist : walks one seggregated list as checkarena does for all of
+ * them
+ */
+
+static void checklist(arena_t *a, unsigned int index)
+{
+	char *bp = GETPTR(BUCKET_ELEM(a,index));
+
+	if ((bp != NULL) != ((a->bucket_map >> index) & 1))
+	{
+		printf("Bucket map does not match list %u\n",index);
+		exit(-1);
+	}
+	if (index == LAST_BUCKET)
+	{
+		checktree(a, bp, NULL, NULL);
+		return;
+	}
+	if (bp != NULL && PREVFREE(bp) != NULL)
+	{
+		printf("Head of list %u has a previous block\n",index);
+		exit(-1);
+	}
+	for (; bp != NULL; bp = NEXTFREE(bp))
+	{
+		if (bp <= a->lo || bp >= a->brk || GET_ALLOC(HDRP(bp)) || 
+				BUCKET_INDEX(GET_SIZE(HDRP(bp))) != index)
+		{
+			printf("Bad block %p in list %u\n",bp,index);
+			exit(-1);
+		}
+		if (NEXTFREE(bp) != NULL && PREVFREE(NEXTFREE(bp)) != bp)
+		{
+			printf("Prev and next pointers are not matching %p\n",bp);
+			exit(-1);
+		}
+	}
+}
@@ -0,0 +1,362 @@
+/*
+ * mmclasses.c - Derives the seggregated list buckets of mm.c from the
+ * request sizes of a set of traces and writes them as mm_classes.h,
+ * which mm.c compiles against when built with MM_CLASSES (make CLASSES=1)
+ *
+ * The block sizes of the malloc and realloc requests (payload plus
+ * header, aligned, as mm.c places them) below the tree minimum are
+ * counted, then split into at most k buckets of consecutive sizes by
+ * dynamic programming, minimizing over the buckets
+ *
+ *     slack / mean + lambda * n * n / total
+ *
+ * where slack is what the requests of the bucket would waste if each got
+ * a block of the largest size of the bucket, mean the mean block size,
+ * n the requests of the bucket and total those of all buckets : the
+ * first term is the internal fragmentation of a first fit in the bucket,
+ * the second the length of its list. The same cost of the built-in
+ * buckets of mm.c is printed for comparison.
+ *
+ * mm.c serves the mallocs of at most SLAB_MAX bytes from slab runs once
+ * their class has seen SLAB_DEMAND of them, so only the first SLAB_DEMAND
+ * mallocs of each class in a trace reach the lists and are counted. Every
+ * trace weighs the same, as in the mdriver averages, so that the few
+ * traces with most requests do not decide the buckets alone.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXLINE    1024
+#define MAX_LISTS  63       /* list buckets, 64 with the tree */
+#define DEF_LISTS  32       /* as many as the built-in buckets */
+#define DEF_TREE   4096     /* smallest block in the tree of mm.c */
+#define SLAB_MAX   128      /* largest malloc served from slabs in mm.c */
+#define SLAB_DEMAND 64      /* mallocs of a class before it gets slabs */
+
+/* Block size of a request in mm.c (32 or 64-bit mode) */
+#define ASIZE(size, w, d) ((size) + (w) + (d) - 1 < 2 * (d) ? 2 * (d) : \
+                           ((size) + (w) + (d) - 1) / (d) * (d))
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* Requests of one block size */
+typedef struct {
+    unsigned long size;
+    double count;
+} size_count_t;
+
+/**************************
+ * Global variables
+ **************************/
+
+static double *hist;          /* share of requests per block size / 8 */
+static double *trace_hist;    /* requests per block size / 8 of a trace */
+static unsigned long requests;  /* requests counted in all traces */
+static unsigned long tree_min = DEF_TREE;
+static unsigned long wsize = 4, dsize = 8;
+static double lambda = 1.0;
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void read_trace(const char *name);
+static double bucket_cost(const size_count_t *s, const double *cnt,
+                          const double *bytes, int i, int j, double mean,
+                          double total);
+static int builtin_bucket(unsigned long size);
+static void usage(void);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    static char *default_traces[] = { DEFAULT_TRACEFILES, NULL };
+    size_count_t *s;
+    double *cnt, *bytes, *cost, total, mean, x, best_cost, builtin;
+    int *from, *limit;
+    int c, k = DEF_LISTS, i, j, b, m, best, prev;
+    unsigned long size;
+    char *out = NULL, name[MAXLINE];
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "k:t:l:o:6h")) != EOF) {
+        switch (c) {
+        case 'k': /* Most list buckets */
+            k = atoi(optarg);
+            break;
+        case 't': /* Smallest block in the tree */
+            tree_min = strtoul(optarg, NULL, 0);
+            break;
+        case 'l': /* Weight of the list length */
+            lambda = atof(optarg);
+            break;
+        case 'o': /* Output file */
+            out = optarg;
+            break;
+        case '6': /* Block sizes of the 64-bit mode */
+            wsize = 8;
+            dsize = 16;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (k < 1 || k > MAX_LISTS || tree_min < 256 || tree_min % 8 != 0 ||
+        tree_min > 1 << 20 || lambda < 0) {
+        usage();
+        exit(1);
+    }
+
+    if ((hist = calloc(tree_min / 8, sizeof(double))) == NULL ||
+        (trace_hist = malloc(tree_min / 8 * sizeof(double))) == NULL)
+        unix_error("malloc failed");
+    if (optind < argc)
+        for (i = optind; i < argc; i++)
+            read_trace(argv[i]);
+    else
+        for (i = 0; default_traces[i] != NULL; i++) {
+            snprintf(name, sizeof(name), "%s%s", TRACEDIR,
+                     default_traces[i]);
+            read_trace(name);
+        }
+
+    /* The sizes seen, with prefix sums of requests and bytes */
+    m = 0;
+    for (i = 0; i < (int)(tree_min / 8); i++)
+        m += hist[i] > 0;
+    if (m == 0) {
+        fprintf(stderr, "No request below %lu bytes in the traces\n",
+                tree_min);
+        exit(1);
+    }
+    if ((s = malloc(m * sizeof(*s))) == NULL ||
+        (cnt = calloc(m + 1, sizeof(double))) == NULL ||
+        (bytes = calloc(m + 1, sizeof(double))) == NULL ||
+        (cost = malloc((m + 1) * (k + 1) * sizeof(double))) == NULL ||
+        (from = malloc((m + 1) * (k + 1) * sizeof(int))) == NULL ||
+        (limit = malloc((k + 1) * sizeof(int))) == NULL)
+        unix_error("malloc failed");
+    for (i = j = 0; i < (int)(tree_min / 8); i++)
+        if (hist[i] > 0) {
+            s[j].size = i * 8UL;
+            s[j].count = hist[i];
+            cnt[j + 1] = cnt[j] + hist[i];
+            bytes[j + 1] = bytes[j] + hist[i] * i * 8.0;
+            j++;
+        }
+    total = cnt[m];
+    mean = bytes[m] / total;
+
+    /* cost[b][j] : best cost of the first j sizes in b buckets */
+#define COST(b, j) cost[(b) * (m + 1) + (j)]
+#define FROM(b, j) from[(b) * (m + 1) + (j)]
+    for (j = 0; j <= m; j++)
+        COST(0, j) = j == 0 ? 0 : -1;
+    for (b = 1; b <= k; b++)
+        for (j = 0; j <= m; j++) {
+            COST(b, j) = j == 0 ? 0 : -1;
+            FROM(b, j) = 0;
+            for (i = b - 1; i < j; i++) {
+                if (COST(b - 1, i) < 0)
+                    continue;
+                x = COST(b - 1, i) + bucket_cost(s, cnt, bytes, i, j, mean,
+                                                 total);
+                if (COST(b, j) < 0 || x < COST(b, j)) {
+                    COST(b, j) = x;
+                    FROM(b, j) = i;
+                }
+            }
+        }
+    best = 1;
+    for (b = 1; b <= k; b++)
+        if (COST(b, m) >= 0 && COST(b, m) < COST(best, m))
+            best = b;
+    best_cost = COST(best, m);
+    for (b = best, j = m; b > 0; b--) {
+        limit[b - 1] = j - 1;     /* last size of bucket b - 1 */
+        j = FROM(b, j);
+    }
+
+    /* The built-in buckets with the same cost */
+    builtin = 0;
+    for (i = 0; i < m; i = j) {
+        for (j = i; j < m && builtin_bucket(s[j].size) ==
+                 builtin_bucket(s[i].size); j++)
+            ;
+        builtin += bucket_cost(s, cnt, bytes, i, j, mean, total);
+    }
+
+    if (out != NULL) {
+        if ((fp = fopen(out, "w")) == NULL)
+            unix_error("Could not open the output file");
+    }
+    else
+        fp = stdout;
+
+    fprintf(fp, "/*\n * mm_classes.h - seggregated list buckets of mm.c "
+            "(make CLASSES=1), written\n * by mmclasses from %lu requests "
+            "of %s traces, do not edit.\n *\n", requests,
+            optind < argc ? "the given" : "the default");
+    fprintf(fp, " * Bucket i holds the free blocks up to the limit below, "
+            "bucket %d (the\n * tree) those of %lu bytes or more.\n", best,
+            tree_min);
+    fprintf(fp, " * Model cost %.1f, %.1f for the built-in buckets "
+            "(mmclasses -l %g%s)\n", best_cost, builtin, lambda,
+            dsize == 16 ? " -6" : "");
+    fprintf(fp, " *\n *   bucket      limit  share of requests\n");
+    for (b = 0, prev = 0; b < best; b++) {
+        fprintf(fp, " *   %6d %10lu %11.1f%%\n", b,
+                b == best - 1 ? tree_min - 1 : s[limit[b]].size,
+                100.0 * (cnt[limit[b] + 1] - cnt[prev]) / total);
+        prev = limit[b] + 1;
+    }
+    fprintf(fp, " */\n\n");
+    fprintf(fp, "#define CLASS_LISTS    %d\n", best);
+    fprintf(fp, "#define CLASS_TREE_MIN %lu\n\n", tree_min);
+    fprintf(fp, "/* Bucket of a block size below CLASS_TREE_MIN, by size / 8 "
+            "*/\n");
+    fprintf(fp, "static const unsigned char class_index[CLASS_TREE_MIN / 8] "
+            "= {");
+    for (size = 0, b = 0; size < tree_min; size += 8) {
+        while (b < best - 1 && size > s[limit[b]].size)
+            b++;
+        fprintf(fp, "%s%2d,", size % 128 == 0 ? "\n    " : " ", b);
+    }
+    fprintf(fp, "\n};\n");
+    if (fp != stdout && fclose(fp) != 0)
+        unix_error("Could not write the output file");
+
+    fprintf(stderr, "%d buckets, model cost %.1f (built-in buckets %.1f)\n",
+            best, best_cost, builtin);
+
+    free(limit);
+    free(from);
+    free(cost);
+    free(bytes);
+    free(cnt);
+    free(s);
+    free(trace_hist);
+    free(hist);
+    exit(0);
+}
+
+/*
+ * read_trace - Counts the block sizes of the malloc and realloc requests
+ * of a trace ("a id size", "r id size") and adds their shares to hist.
+ * Frees, region arena requests, requests without a size and the mallocs
+ * mm.c serves from slabs are skipped
+ */
+static void read_trace(const char *name)
+{
+    char line[MAXLINE];
+    int weight, num_ids, num_ops, ignore, id;
+    unsigned long size, asize, n = 0, i;
+    unsigned int demand[SLAB_MAX / 8];  /* mallocs per slab class */
+    FILE *fp;
+
+    if ((fp = fopen(name, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &weight, &num_ids, &num_ops,
+               &ignore) != 4) {
+        fprintf(stderr, "%s is not a trace\n", name);
+        exit(1);
+    }
+    memset(demand, 0, sizeof(demand));
+    memset(trace_hist, 0, tree_min / 8 * sizeof(double));
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((line[0] != 'a' && line[0] != 'r') ||
+            sscanf(line + 1, "%d %lu", &id, &size) != 2 || size == 0)
+            continue;
+        if (line[0] == 'a' && size <= SLAB_MAX &&
+            ++demand[(size - 1) / dsize] > SLAB_DEMAND)
+            continue;
+        asize = ASIZE(size, wsize, dsize);
+        if (asize < tree_min) {
+            trace_hist[asize / 8]++;
+            n++;
+        }
+    }
+    fclose(fp);
+    for (i = 0; n > 0 && i < tree_min / 8; i++)
+        hist[i] += trace_hist[i] / n;
+    requests += n;
+}
+
+/*
+ * bucket_cost - Cost of one bucket of the sizes s[i] .. s[j - 1]
+ */
+static double bucket_cost(const size_count_t *s, const double *cnt,
+                          const double *bytes, int i, int j, double mean,
+                          double total)
+{
+    double n = cnt[j] - cnt[i];
+    double slack = s[j - 1].size * n - (bytes[j] - bytes[i]);
+
+    return slack / mean + lambda * n * n / total;
+}
+
+/*
+ * builtin_bucket - BUCKET_INDEX of mm.c without MM_CLASSES : one bucket
+ * per 8 bytes below 64, then four per power of two up to the tree (32)
+ */
+static int builtin_bucket(unsigned long size)
+{
+    int msb;
+
+    if (size < 64)
+        return size >> 3;
+    msb = 63 - __builtin_clzl(size);
+    if (msb >= 12)
+        return 32;
+    return 8 + ((msb - 6) << 2) + ((size >> (msb - 2)) & 3);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmclasses [-h6] [-k <n>] [-t <bytes>] "
+            "[-l <weight>] [-o <file>] [trace ...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-6         Block sizes of the 64-bit mode.\n");
+    fprintf(stderr, "\t-k <n>     Most list buckets, 1 - %d (default %d).\n",
+            MAX_LISTS, DEF_LISTS);
+    fprintf(stderr, "\t-t <bytes> Smallest block in the tree (default %d).\n",
+            DEF_TREE);
+    fprintf(stderr, "\t-l <w>     Weight of the list length (default 1).\n");
+    fprintf(stderr, "\t-o <file>  Write the header to file (default "
+            "stdout).\n");
+    fprintf(stderr, "The default traces are those of config.h in %s.\n",
+            TRACEDIR);
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
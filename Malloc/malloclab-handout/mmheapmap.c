@@ -0,0 +1,431 @@
+/*
+ * mmheapmap.c - Renders the heap maps written by mdriver -M (mm.c built
+ * with MM_STATS) to see where the heap fragments over time
+ *
+ * Each map of the file becomes one line of text (or rows of pixels with
+ * -p), the whole width being the largest heap of the file, so that the
+ * lines of successive maps line up:
+ *
+ *     op   util  |##.##:#s###   ....   |
+ *
+ * '#' allocated, 's' slab runs, '.' free, ':' as much free as allocated,
+ * ' ' past the end of the heap. The PPM image colors allocated blocks by
+ * their size class (hue) and slab runs by how full they are, free bytes
+ * are black. After the maps, the free and allocated blocks of each class
+ * are listed for the map with the most free bytes while blocks are live.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXLINE   1024
+#define DEF_WIDTH 100     /* characters or pixels per map */
+#define CLASSES   64      /* size classes and slab classes of mm.c */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* One line of a map */
+typedef struct {
+    unsigned long off;    /* offset in the arena */
+    unsigned long size;
+    char kind;            /* a allocated, f free, s slab run */
+    unsigned int cls;     /* bucket or slab class */
+    unsigned int used;    /* used slots of a slab run */
+    unsigned int slots;   /* slots of a slab run */
+} block_t;
+
+/* One map : its blocks are blocks[first .. first + count - 1] */
+typedef struct {
+    int op;               /* map taken after this op */
+    long payload;         /* payload bytes live then */
+    unsigned long heap;   /* heap bytes of the arena */
+    long first;
+    long count;
+} map_t;
+
+/* Bytes of each kind and color sums of one character or pixel */
+typedef struct {
+    double alloc, freeb, slab;
+    double r, g, b;
+} cell_t;
+
+/**************************
+ * Global variables
+ **************************/
+
+static block_t *blocks;
+static long num_blocks, max_blocks;
+static map_t *maps;
+static int num_maps, max_maps;
+static unsigned long max_heap;
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static void read_maps(FILE *fp, unsigned int arena);
+static void fill_cells(map_t *m, cell_t *cells, int width);
+static void color(block_t *b, double *r, double *g, double *b_);
+static void print_text(int width);
+static void write_ppm(const char *name, int width, int height);
+static void print_classes(void);
+static void usage(void);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, width = DEF_WIDTH, height = 2;
+    unsigned int arena = 0;
+    char *ppm = NULL;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "w:a:p:r:h")) != EOF) {
+        switch (c) {
+        case 'w': /* Characters or pixels per map */
+            width = atoi(optarg);
+            break;
+        case 'a': /* Arena to render */
+            arena = atoi(optarg);
+            break;
+        case 'p': /* Write a PPM image */
+            ppm = optarg;
+            break;
+        case 'r': /* Pixel rows per map in the image */
+            height = atoi(optarg);
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || width < 1 || height < 1) {
+        usage();
+        exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "r")) == NULL)
+        unix_error("Could not open the map file");
+    read_maps(fp, arena);
+    fclose(fp);
+    if (num_maps == 0 || max_heap == 0) {
+        fprintf(stderr, "No heap map of arena %u in %s\n", arena,
+                argv[optind]);
+        exit(1);
+    }
+
+    if (ppm != NULL)
+        write_ppm(ppm, width, height);
+    else
+        print_text(width);
+    print_classes();
+    exit(0);
+}
+
+/*
+ * read_maps - reads the maps of one arena, each starting with an op line
+ */
+static void read_maps(FILE *fp, unsigned int arena)
+{
+    char line[MAXLINE], kind;
+    unsigned int index, in_arena = 0;
+    unsigned long heap;
+    block_t *b;
+    map_t *m = NULL;
+    int op;
+    long payload;
+
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if (sscanf(line, "op %d %ld", &op, &payload) == 2) {
+            if (num_maps == max_maps) {
+                max_maps = max_maps ? 2 * max_maps : 64;
+                if ((maps = realloc(maps, max_maps * sizeof(map_t))) == NULL)
+                    unix_error("realloc failed in read_maps");
+            }
+            m = &maps[num_maps++];
+            m->op = op;
+            m->payload = payload;
+            m->heap = 0;
+            m->first = num_blocks;
+            m->count = 0;
+            in_arena = 0;
+        }
+        else if (sscanf(line, "arena %u %lu", &index, &heap) == 2) {
+            in_arena = (m != NULL && index == arena);
+            if (in_arena) {
+                m->heap = heap;
+                if (heap > max_heap)
+                    max_heap = heap;
+            }
+        }
+        else if (in_arena) {
+            if (num_blocks == max_blocks) {
+                max_blocks = max_blocks ? 2 * max_blocks : 4096;
+                blocks = realloc(blocks, max_blocks * sizeof(block_t));
+                if (blocks == NULL)
+                    unix_error("realloc failed in read_maps");
+            }
+            b = &blocks[num_blocks];
+            b->used = b->slots = 0;
+            if (sscanf(line, "%lu %lu %c %u %u %u", &b->off, &b->size, &kind,
+                       &b->cls, &b->used, &b->slots) < 4) {
+                fprintf(stderr, "Bad line in the map of op %d: %s", m->op,
+                        line);
+                exit(1);
+            }
+            b->kind = kind;
+            if (b->cls >= CLASSES)
+                b->cls = CLASSES - 1;
+            num_blocks++;
+            m->count++;
+        }
+    }
+}
+
+/*
+ * fill_cells - spreads the bytes of each block of a map over the cells
+ * (max_heap / width bytes each) it covers
+ */
+static void fill_cells(map_t *m, cell_t *cells, int width)
+{
+    double cell = (double)max_heap / width, lo, hi, n, r, g, bl;
+    block_t *b;
+    long i;
+    int j;
+
+    memset(cells, 0, width * sizeof(cell_t));
+    for (i = m->first; i < m->first + m->count; i++) {
+        b = &blocks[i];
+        color(b, &r, &g, &bl);
+        for (j = b->off / cell; j < width && j * cell < b->off + b->size;
+             j++) {
+            lo = j * cell > b->off ? j * cell : b->off;
+            hi = (j + 1) * cell < b->off + b->size ? (j + 1) * cell :
+                b->off + b->size;
+            if ((n = hi - lo) <= 0)
+                continue;
+            if (b->kind == 'f')
+                cells[j].freeb += n;
+            else if (b->kind == 's')
+                cells[j].slab += n;
+            else
+                cells[j].alloc += n;
+            cells[j].r += n * r;
+            cells[j].g += n * g;
+            cells[j].b += n * bl;
+        }
+    }
+}
+
+/*
+ * color - color of a block (0..1 each) : hue of its class when allocated,
+ * slab runs from dark to bright orange as they fill, free blocks black
+ */
+static void color(block_t *b, double *r, double *g, double *b_)
+{
+    double h, f, x, full;
+
+    *r = *g = *b_ = 0;
+    if (b->kind == 'f')
+        return;
+    if (b->kind == 's') {
+        full = b->slots ? 0.3 + 0.7 * b->used / b->slots : 1;
+        *r = full;
+        *g = 0.5 * full;
+        return;
+    }
+    /* Hue around the color wheel, 6 sectors, for the class */
+    h = 6.0 * (b->cls * 7 % CLASSES) / CLASSES;
+    f = h - 2 * (int)(h / 2);       /* h mod 2 */
+    x = f < 1 ? f : 2 - f;
+    switch ((int)h) {
+    case 0: *r = 1; *g = x; break;
+    case 1: *r = x; *g = 1; break;
+    case 2: *g = 1; *b_ = x; break;
+    case 3: *g = x; *b_ = 1; break;
+    case 4: *r = x; *b_ = 1; break;
+    default: *r = 1; *b_ = x; break;
+    }
+}
+
+/*
+ * print_text - one line per map
+ */
+static void print_text(int width)
+{
+    cell_t *cells;
+    double used, all;
+    int i, j;
+
+    if ((cells = malloc(width * sizeof(cell_t))) == NULL)
+        unix_error("malloc failed in print_text");
+    printf("heap of %lu bytes, %.0f bytes per character : # allocated, "
+           "s slab runs, . free, : half free\n", max_heap,
+           (double)max_heap / width);
+    printf("%8s %5s\n", "op", "util");
+    for (i = 0; i < num_maps; i++) {
+        fill_cells(&maps[i], cells, width);
+        printf("%8d %4.0f%%  |", maps[i].op, maps[i].heap ?
+               100.0 * maps[i].payload / maps[i].heap : 0.0);
+        for (j = 0; j < width; j++) {
+            used = cells[j].alloc + cells[j].slab;
+            all = used + cells[j].freeb;
+            if (all == 0)
+                putchar(' ');
+            else if (cells[j].freeb > 0.75 * all)
+                putchar('.');
+            else if (cells[j].freeb > 0.25 * all)
+                putchar(':');
+            else
+                putchar(cells[j].slab > cells[j].alloc ? 's' : '#');
+        }
+        printf("|\n");
+    }
+    free(cells);
+}
+
+/*
+ * write_ppm - one map per height rows of pixels, in binary PPM (P6)
+ */
+static void write_ppm(const char *name, int width, int height)
+{
+    cell_t *cells;
+    unsigned char *row;
+    double all;
+    int i, j, k;
+    FILE *fp;
+
+    if ((cells = malloc(width * sizeof(cell_t))) == NULL ||
+        (row = malloc(3 * width)) == NULL)
+        unix_error("malloc failed in write_ppm");
+    if ((fp = fopen(name, "wb")) == NULL)
+        unix_error("Could not open the image");
+
+    fprintf(fp, "P6\n%d %d\n255\n", width, num_maps * height);
+    for (i = 0; i < num_maps; i++) {
+        fill_cells(&maps[i], cells, width);
+        for (j = 0; j < width; j++) {
+            all = cells[j].alloc + cells[j].slab + cells[j].freeb;
+            if (all == 0) {
+                /* past the end of the heap */
+                row[3 * j] = row[3 * j + 1] = row[3 * j + 2] = 255;
+                continue;
+            }
+            row[3 * j] = 255 * cells[j].r / all;
+            row[3 * j + 1] = 255 * cells[j].g / all;
+            row[3 * j + 2] = 255 * cells[j].b / all;
+        }
+        for (k = 0; k < height; k++)
+            fwrite(row, 3, width, fp);
+    }
+    if (fclose(fp) != 0)
+        unix_error("Could not write the image");
+    printf("%d maps of a heap of %lu bytes written to %s\n", num_maps,
+           max_heap, name);
+    free(row);
+    free(cells);
+}
+
+/*
+ * print_classes - blocks and bytes per class in the map with the most
+ * free bytes while some payload is live (the heap is all free once the
+ * trace freed everything), to see which classes hold the free memory
+ */
+static void print_classes(void)
+{
+    unsigned long nfree[CLASSES], free_bytes[CLASSES];
+    unsigned long nalloc[CLASSES], alloc_bytes[CLASSES];
+    unsigned long nruns[CLASSES], used[CLASSES], slots[CLASSES];
+    unsigned long most = 0, sum;
+    block_t *b;
+    map_t *m = &maps[0];
+    long i;
+    int j;
+
+    for (j = 0; j < num_maps; j++) {
+        sum = 0;
+        for (i = maps[j].first; i < maps[j].first + maps[j].count; i++)
+            if (blocks[i].kind == 'f')
+                sum += blocks[i].size;
+        if (sum > most && maps[j].payload > 0) {
+            most = sum;
+            m = &maps[j];
+        }
+    }
+
+    memset(nfree, 0, sizeof(nfree));
+    memset(free_bytes, 0, sizeof(free_bytes));
+    memset(nalloc, 0, sizeof(nalloc));
+    memset(alloc_bytes, 0, sizeof(alloc_bytes));
+    memset(nruns, 0, sizeof(nruns));
+    memset(used, 0, sizeof(used));
+    memset(slots, 0, sizeof(slots));
+    for (i = m->first; i < m->first + m->count; i++) {
+        b = &blocks[i];
+        if (b->kind == 'f') {
+            nfree[b->cls]++;
+            free_bytes[b->cls] += b->size;
+        }
+        else if (b->kind == 's') {
+            nruns[b->cls]++;
+            used[b->cls] += b->used;
+            slots[b->cls] += b->slots;
+        }
+        else {
+            nalloc[b->cls]++;
+            alloc_bytes[b->cls] += b->size;
+        }
+    }
+
+    printf("\nmost free bytes with blocks live at op %d : %lu free in a "
+           "heap of %lu\n", m->op, most, m->heap);
+    printf("%-10s %10s %12s %10s %12s\n", "class", "free", "free bytes",
+           "allocated", "bytes");
+    for (j = 0; j < CLASSES; j++)
+        if (nfree[j] || nalloc[j])
+            printf("bucket %-3d %10lu %12lu %10lu %12lu\n", j, nfree[j],
+                   free_bytes[j], nalloc[j], alloc_bytes[j]);
+    for (j = 0; j < CLASSES; j++)
+        if (nruns[j])
+            printf("slab %-5d %10lu runs, %lu of %lu slots used\n", j,
+                   nruns[j], used[j], slots[j]);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmheapmap [-h] [-w <n>] [-a <n>] "
+            "[-p <file> [-r <n>]] <file.map>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-w <n>     Characters or pixels per map (default %d).\n",
+            DEF_WIDTH);
+    fprintf(stderr, "\t-a <n>     Render arena n (default 0).\n");
+    fprintf(stderr, "\t-p <file>  Write a PPM image instead of text.\n");
+    fprintf(stderr, "\t-r <n>     Pixel rows per map in the image "
+            "(default 2).\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
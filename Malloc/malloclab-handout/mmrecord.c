@@ -0,0 +1,471 @@
+/*
+ * mmrecord.c - Records the malloc, calloc, realloc and free calls of a
+ * running program as an mdriver trace (libmmrecord.so):
+ *
+ *     unix> LD_PRELOAD=$PWD/libmmrecord.so MMRECORD=app.rep ./app
+ *     unix> ./mdriver -f app.rep
+ *
+ * Every call is appended to a buffer of the calling thread, without any
+ * lock : the buffer belongs to the thread and only the global sequence
+ * number is taken with an atomic add. Full buffers are pushed on a lock
+ * free stack which a writer thread empties into a raw file (app.rep.raw),
+ * so the program never waits for the disk. At exit the raw records are
+ * sorted by sequence number and turned into app.rep : pointers become
+ * block ids, and the id of a freed block goes to the next allocation so
+ * that num_ids stays the largest number of blocks live at once.
+ *
+ * Only the process which loaded the library records (not its children).
+ * calloc is recorded as an allocation, frees of blocks allocated before
+ * the recorder started (or by memalign and the like) are dropped, and so
+ * are the calls of threads still running at exit that are not in a full
+ * buffer yet. The buffers of the recorder come from mmap.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define BUF_RECORDS 4096      /* records per thread buffer */
+#define BOOT_SIZE   (64*1024) /* memory for dlsym before malloc is found */
+#define WRITER_NAP  1000000   /* ns the writer sleeps on an empty stack */
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+enum { ALLOC, REALLOC, FREE };
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* One call of the program */
+typedef struct {
+    unsigned long seq;    /* order of the call among all threads */
+    int type;             /* ALLOC, REALLOC or FREE */
+    size_t size;          /* bytes asked (ALLOC, REALLOC) */
+    void *ptr;            /* block freed or reallocated */
+    void *newptr;         /* block returned */
+} record_t;
+
+/* Records of a thread, linked on the stack of full buffers */
+typedef struct buffer {
+    struct buffer *next;
+    int count;
+    record_t records[BUF_RECORDS];
+} buffer_t;
+
+/* Block id of a live pointer while the trace is written */
+typedef struct {
+    void *ptr;            /* NULL : empty, TOMB : removed */
+    int id;
+} slot_t;
+
+#define TOMB ((void *)1)
+
+/**************************
+ * Global variables
+ **************************/
+
+static void *(*real_malloc)(size_t size);
+static void (*real_free)(void *ptr);
+static void *(*real_realloc)(void *ptr, size_t size);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+
+static char boot[BOOT_SIZE];  /* handed out while dlsym runs */
+static size_t boot_used;
+
+static int recording;         /* cleared at exit and in children */
+static unsigned long seq;
+static buffer_t *full;        /* lock free stack of full buffers */
+static int stopping;
+static pthread_t writer_tid;
+static pthread_key_t buf_key; /* flushes the buffer of an exiting thread */
+static int raw_fd = -1;
+static char rep_name[PATH_MAX];
+static char raw_name[PATH_MAX + 4];
+
+static __thread buffer_t *buf;
+static __thread int busy;     /* the thread is inside the recorder */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static record_t *record(int type, void *ptr, void *newptr, size_t size);
+static void push(buffer_t *b);
+static void *writer(void *arg);
+static void thread_exit(void *arg);
+static void in_child(void);
+static void write_trace(void);
+static int lookup(slot_t *table, size_t mask, void *ptr, int remove);
+static void insert(slot_t *table, size_t mask, void *ptr, int id);
+static int by_seq(const void *a, const void *b);
+
+/*
+ * start - finds the functions of the real malloc, then opens the raw file
+ * and starts the writer before anything is recorded
+ */
+__attribute__((constructor))
+static void start(void)
+{
+    const char *name = getenv("MMRECORD");
+
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+
+    if (name != NULL)
+        snprintf(rep_name, sizeof(rep_name), "%s", name);
+    else
+        snprintf(rep_name, sizeof(rep_name), "mmrecord.%d.rep",
+                 (int)getpid());
+    snprintf(raw_name, sizeof(raw_name), "%s.raw", rep_name);
+    if ((raw_fd = open(raw_name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "mmrecord: cannot open %s: %s\n", raw_name,
+                strerror(errno));
+        return;
+    }
+
+    busy = 1;
+    pthread_key_create(&buf_key, thread_exit);
+    pthread_atfork(NULL, NULL, in_child);
+    if ((errno = pthread_create(&writer_tid, NULL, writer, NULL)) != 0) {
+        fprintf(stderr, "mmrecord: cannot start the writer: %s\n",
+                strerror(errno));
+        busy = 0;
+        return;
+    }
+    busy = 0;
+    recording = 1;
+}
+
+/*
+ * finish - stops recording, flushes the buffer of this thread, waits for
+ * the writer to write everything and turns the raw file into the trace
+ */
+__attribute__((destructor))
+static void finish(void)
+{
+    if (!recording)
+        return;
+    recording = 0;
+    busy = 1;
+    if (buf != NULL) {
+        push(buf);
+        buf = NULL;
+    }
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(writer_tid, NULL);
+    write_trace();
+    close(raw_fd);
+    unlink(raw_name);
+}
+
+/*
+ * The interposed functions : memory from the real malloc, recorded
+ */
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        /* dlsym itself may allocate */
+        size = (size + 15) & ~(size_t)15;
+        if (boot_used + size > BOOT_SIZE)
+            return NULL;
+        p = boot + boot_used;
+        boot_used += size;
+        return p;
+    }
+    p = real_malloc(size);
+    record(ALLOC, NULL, p, size);
+    return p;
+}
+
+void free(void *ptr)
+{
+    if ((char *)ptr >= boot && (char *)ptr < boot + BOOT_SIZE)
+        return;
+    record(FREE, ptr, NULL, 0);
+    real_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+    record_t *r;
+
+    if ((char *)ptr >= boot && (char *)ptr < boot + BOOT_SIZE) {
+        /* Move a boot block to the real malloc, it was never recorded */
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, MIN(size, (size_t)(boot + BOOT_SIZE -
+                                                (char *)ptr)));
+        return p;
+    }
+    /*
+     * Like free, the sequence number is taken before the old block can go
+     * back to the real malloc and be handed to another thread. The record
+     * stays in this thread's buffer (busy) until the new block is known.
+     */
+    if ((r = record(REALLOC, ptr, NULL, size)) != NULL)
+        busy = 1;
+    p = real_realloc(ptr, size);
+    if (r != NULL) {
+        r->newptr = p;
+        busy = 0;
+    }
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        /* boot memory is static, so already zero */
+        if (size != 0 && nmemb > (size_t)-1 / size)
+            return NULL;
+        return malloc(nmemb * size);
+    }
+    p = real_calloc(nmemb, size);
+    record(ALLOC, NULL, p, nmemb * size);
+    return p;
+}
+
+/*
+ * record - appends a call to the buffer of the thread, which goes to the
+ * writer once full. Returns the record, or NULL if the call is not recorded
+ */
+static record_t *record(int type, void *ptr, void *newptr, size_t size)
+{
+    record_t *r;
+
+    if (!recording || busy)
+        return NULL;
+    busy = 1;
+    if (buf == NULL || buf->count == BUF_RECORDS) {
+        if (buf != NULL)
+            push(buf);
+        buf = mmap(NULL, sizeof(buffer_t), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            buf = NULL;
+            busy = 0;
+            return NULL;
+        }
+        pthread_setspecific(buf_key, buf);
+    }
+    r = &buf->records[buf->count++];
+    r->seq = __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+    r->type = type;
+    r->size = size;
+    r->ptr = ptr;
+    r->newptr = newptr;
+    busy = 0;
+    return r;
+}
+
+/*
+ * push - pushes a buffer on the stack of full buffers with compare and swap
+ */
+static void push(buffer_t *b)
+{
+    buffer_t *head = __atomic_load_n(&full, __ATOMIC_RELAXED);
+
+    do {
+        b->next = head;
+    } while (!__atomic_compare_exchange_n(&full, &head, b, 1,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/*
+ * writer - takes the whole stack at once (so there is no ABA problem) and
+ * writes its buffers to the raw file, until finish stops it and the stack
+ * is empty
+ */
+static void *writer(void *arg)
+{
+    struct timespec nap = { 0, WRITER_NAP };
+    buffer_t *b, *next;
+    int stop;
+
+    (void)arg;
+    busy = 1;
+    for (;;) {
+        stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+        b = __atomic_exchange_n(&full, NULL, __ATOMIC_ACQUIRE);
+        if (b == NULL) {
+            if (stop)
+                return NULL;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        for (; b != NULL; b = next) {
+            next = b->next;
+            if (write(raw_fd, b->records, b->count * sizeof(record_t)) < 0)
+                fprintf(stderr, "mmrecord: write failed: %s\n",
+                        strerror(errno));
+            munmap(b, sizeof(buffer_t));
+        }
+    }
+}
+
+/*
+ * thread_exit - the buffer of an exiting thread goes to the writer
+ */
+static void thread_exit(void *arg)
+{
+    if (arg != NULL && recording)
+        push(arg);
+    buf = NULL;
+}
+
+/*
+ * in_child - a child of the program does not record (and has no writer)
+ */
+static void in_child(void)
+{
+    recording = 0;
+}
+
+/*
+ * write_trace - sorts the raw records by sequence number and writes them
+ * as a trace. The header lines are written last, with room left for them
+ */
+static void write_trace(void)
+{
+    struct stat st;
+    record_t *r;
+    slot_t *table;
+    int *ids;
+    size_t n, i, mask;
+    int num_ids = 0, num_free = 0, num_ops = 0, id;
+    FILE *fp;
+
+    if (fstat(raw_fd, &st) < 0 || st.st_size == 0)
+        return;
+    n = st.st_size / sizeof(record_t);
+    r = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+             raw_fd, 0);
+    if (r == MAP_FAILED)
+        return;
+    qsort(r, n, sizeof(record_t), by_seq);
+
+    /* At most n blocks are ever live, the table stays half empty */
+    for (mask = 1; mask < 2 * n; mask <<= 1)
+        ;
+    table = real_calloc(mask, sizeof(slot_t));
+    ids = real_malloc(n * sizeof(int));
+    mask--;
+    if (table == NULL || ids == NULL || (fp = fopen(rep_name, "w")) == NULL) {
+        fprintf(stderr, "mmrecord: cannot write %s\n", rep_name);
+        munmap(r, st.st_size);
+        return;
+    }
+    fprintf(fp, "%-12d\n%-12d\n%-12d\n%-12d\n", 0, 0, 0, 0);
+
+    for (i = 0; i < n; i++) {
+        /* realloc of a block unknown here, or of NULL, is a malloc */
+        if (r[i].type == REALLOC && (r[i].ptr == NULL ||
+                                     lookup(table, mask, r[i].ptr, 0) < 0))
+            r[i].type = ALLOC;
+        /* realloc to 0 bytes freed the block */
+        if (r[i].type == REALLOC && r[i].size == 0 && r[i].newptr == NULL)
+            r[i].type = FREE;
+
+        switch (r[i].type) {
+        case ALLOC:
+            if (r[i].newptr == NULL || r[i].size > INT_MAX)
+                break;
+            id = num_free ? ids[--num_free] : num_ids++;
+            insert(table, mask, r[i].newptr, id);
+            fprintf(fp, "a %d %zu\n", id, r[i].size);
+            num_ops++;
+            break;
+        case REALLOC:
+            if (r[i].newptr == NULL || r[i].size > INT_MAX)
+                break;
+            id = lookup(table, mask, r[i].ptr, 1);
+            insert(table, mask, r[i].newptr, id);
+            fprintf(fp, "r %d %zu\n", id, r[i].size);
+            num_ops++;
+            break;
+        case FREE:
+            if (r[i].ptr == NULL) {
+                fprintf(fp, "f -1\n");
+                num_ops++;
+            }
+            else if ((id = lookup(table, mask, r[i].ptr, 1)) >= 0) {
+                ids[num_free++] = id;
+                fprintf(fp, "f %d\n", id);
+                num_ops++;
+            }
+            break;
+        }
+    }
+
+    /* weight 0 : the trace is not part of the score */
+    rewind(fp);
+    fprintf(fp, "%-12d\n%-12d\n%-12d\n%-12d\n", 0, num_ids, num_ops, 0);
+    if (fclose(fp) != 0)
+        fprintf(stderr, "mmrecord: cannot write %s\n", rep_name);
+    real_free(table);
+    real_free(ids);
+    munmap(r, st.st_size);
+}
+
+/*
+ * lookup - returns the id of ptr (and removes it if remove is set) or -1
+ */
+static int lookup(slot_t *table, size_t mask, void *ptr, int remove)
+{
+    size_t i = ((size_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL & mask;
+
+    for (; table[i].ptr != NULL; i = (i + 1) & mask) {
+        if (table[i].ptr == ptr) {
+            if (remove)
+                table[i].ptr = TOMB;
+            return table[i].id;
+        }
+    }
+    return -1;
+}
+
+/*
+ * insert - adds ptr with its id, reusing a removed slot on the way
+ */
+static void insert(slot_t *table, size_t mask, void *ptr, int id)
+{
+    size_t i = ((size_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL & mask;
+
+    while (table[i].ptr != NULL && table[i].ptr != TOMB)
+        i = (i + 1) & mask;
+    table[i].ptr = ptr;
+    table[i].id = id;
+}
+
+/*
+ * by_seq - qsort order of the records
+ */
+static int by_seq(const void *a, const void *b)
+{
+    unsigned long x = ((const record_t *)a)->seq;
+    unsigned long y = ((const record_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,315 @@
+/*
+ * mtdriver.c - Multithreaded scaling driver for mm.c
+ *
+ * Runs the same random malloc/free workload with 1, 2, ... threads and
+ * reports the throughput of each run and its speedup over one thread.
+ * Each thread keeps a working set of blocks (mostly small, some medium)
+ * and hands one in every HANDOFF frees to the next thread, which frees
+ * it, so that blocks are also freed by threads other than their owner.
+ *
+ * mm.c must be built with MM_THREADS (see the Makefile).
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define SLOTS      1024   /* working set of blocks per thread */
+#define MAILBOX    256    /* blocks waiting to be freed by a thread */
+#define HANDOFF    8      /* one free in HANDOFF goes to the next thread */
+#define SMALL_MAX  256    /* 7 requests in 8 are 1..SMALL_MAX bytes */
+#define MEDIUM_MAX 4096   /* the others are SMALL_MAX..MEDIUM_MAX bytes */
+#define DEF_OPS    1000000 /* operations per thread */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* Blocks handed to a thread by the previous one */
+typedef struct {
+    pthread_mutex_t lock;
+    int count;
+    void *blocks[MAILBOX];
+} mailbox_t;
+
+/* Per thread state */
+typedef struct {
+    pthread_t tid;
+    int id;
+    unsigned int seed;
+    int failed;            /* malloc returned NULL */
+} worker_t;
+
+/**************************
+ * Global variables
+ **************************/
+
+static int nthreads;       /* threads of the current run */
+static long ops = DEF_OPS; /* operations per thread */
+static mailbox_t *mailboxes;
+static pthread_barrier_t barrier; /* workers and main at the start */
+static pthread_barrier_t done;    /* workers at the end */
+
+/* The allocator under test */
+static void *(*malloc_fn)(size_t size);
+static void (*free_fn)(void *ptr);
+
+/*********************
+ * Function prototypes
+ *********************/
+
+static double run(int threads);
+static void *worker(void *arg);
+static void handoff(int to, void *bp);
+static void drain(int id);
+static double now(void);
+static void usage(void);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    int maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int run_libc = 0;
+    double base, tput, lbase = 0, ltput;
+
+    while ((c = getopt(argc, argv, "t:n:lh")) != EOF) {
+        switch (c) {
+        case 't': /* Run with 1..t threads */
+            maxthreads = atoi(optarg);
+            break;
+        case 'n': /* Operations per thread */
+            ops = atol(optarg);
+            break;
+        case 'l': /* Also run libc malloc */
+            run_libc = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (maxthreads < 1 || ops < 1) {
+        usage();
+        exit(1);
+    }
+
+    mem_init();
+    if ((mailboxes = calloc(maxthreads, sizeof(mailbox_t))) == NULL)
+        unix_error("calloc failed in main");
+    for (i = 0; i < maxthreads; i++)
+        pthread_mutex_init(&mailboxes[i].lock, NULL);
+
+    printf("%ld ops per thread, %d threads max\n", ops, maxthreads);
+    printf("%8s %12s %8s", "threads", "mm Kops/s", "speedup");
+    if (run_libc)
+        printf(" %12s %8s", "libc Kops/s", "speedup");
+    printf("\n");
+
+    base = 0;
+    for (i = 1; i <= maxthreads; i++) {
+        malloc_fn = mm_malloc;
+        free_fn = mm_free;
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_init failed\n");
+            exit(1);
+        }
+        tput = run(i);
+        if (i == 1)
+            base = tput;
+        printf("%8d %12.0f %8.2f", i, tput / 1e3, tput / base);
+
+        if (run_libc) {
+            malloc_fn = malloc;
+            free_fn = free;
+            ltput = run(i);
+            if (i == 1)
+                lbase = ltput;
+            printf(" %12.0f %8.2f", ltput / 1e3, ltput / lbase);
+        }
+        printf("\n");
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - runs the workload with the given number of threads and returns
+ * its throughput in operations per second
+ */
+static double run(int threads)
+{
+    worker_t *w;
+    double start, secs;
+    int i, failed = 0;
+
+    nthreads = threads;
+    if ((w = calloc(threads, sizeof(worker_t))) == NULL)
+        unix_error("calloc failed in run");
+    pthread_barrier_init(&barrier, NULL, threads + 1);
+    pthread_barrier_init(&done, NULL, threads);
+
+    for (i = 0; i < threads; i++) {
+        w[i].id = i;
+        w[i].seed = i + 1;
+        mailboxes[i].count = 0;
+        if ((errno = pthread_create(&w[i].tid, NULL, worker, &w[i])) != 0)
+            unix_error("pthread_create failed in run");
+    }
+
+    pthread_barrier_wait(&barrier);
+    start = now();
+    for (i = 0; i < threads; i++) {
+        pthread_join(w[i].tid, NULL);
+        failed |= w[i].failed;
+    }
+    secs = now() - start;
+
+    if (failed) {
+        fprintf(stderr, "malloc failed with %d threads\n", threads);
+        exit(1);
+    }
+    pthread_barrier_destroy(&barrier);
+    pthread_barrier_destroy(&done);
+    free(w);
+    return (double)ops * threads / secs;
+}
+
+/*
+ * worker - frees or allocates a random slot of its working set at every
+ * step, and frees what the previous thread handed over every SLOTS steps
+ */
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    void *slots[SLOTS];
+    long i;
+    int r;
+    size_t size;
+
+    memset(slots, 0, sizeof(slots));
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < ops; i++) {
+        r = rand_r(&w->seed);
+        if (slots[r % SLOTS] != NULL) {
+            if (nthreads > 1 && (r >> 10) % HANDOFF == 0)
+                handoff((w->id + 1) % nthreads, slots[r % SLOTS]);
+            else
+                free_fn(slots[r % SLOTS]);
+            slots[r % SLOTS] = NULL;
+        }
+        else {
+            if ((r >> 10) % 8)
+                size = 1 + (r >> 13) % SMALL_MAX;
+            else
+                size = SMALL_MAX + (r >> 13) % (MEDIUM_MAX - SMALL_MAX);
+            if ((slots[r % SLOTS] = malloc_fn(size)) == NULL) {
+                w->failed = 1;
+                break;
+            }
+            /* Touch the block like a real program would */
+            *(char *)slots[r % SLOTS] = (char)i;
+        }
+        if (i % SLOTS == 0)
+            drain(w->id);
+    }
+
+    for (r = 0; r < SLOTS; r++)
+        if (slots[r] != NULL)
+            free_fn(slots[r]);
+
+    /* Nobody hands blocks over once every thread got here */
+    pthread_barrier_wait(&done);
+    drain(w->id);
+    return NULL;
+}
+
+/*
+ * handoff - gives a block to thread to, which frees it; the block is
+ * freed here if the mailbox of that thread is full
+ */
+static void handoff(int to, void *bp)
+{
+    mailbox_t *m = &mailboxes[to];
+
+    pthread_mutex_lock(&m->lock);
+    if (m->count < MAILBOX) {
+        m->blocks[m->count++] = bp;
+        bp = NULL;
+    }
+    pthread_mutex_unlock(&m->lock);
+    if (bp != NULL)
+        free_fn(bp);
+}
+
+/*
+ * drain - frees every block in the mailbox of thread id
+ */
+static void drain(int id)
+{
+    mailbox_t *m = &mailboxes[id];
+    void *blocks[MAILBOX];
+    int i, count;
+
+    pthread_mutex_lock(&m->lock);
+    count = m->count;
+    memcpy(blocks, m->blocks, count * sizeof(void *));
+    m->count = 0;
+    pthread_mutex_unlock(&m->lock);
+
+    for (i = 0; i < count; i++)
+        free_fn(blocks[i]);
+}
+
+/*
+ * now - wall clock time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtdriver [-hl] [-t <n>] [-n <n>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-n <n>     Operations per thread (default %d).\n",
+            DEF_OPS);
+    fprintf(stderr, "\t-t <n>     Run with 1..n threads (default: cpus).\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
@@ -0,0 +1,135 @@
+#!/bin/bash
+#
+# shootout.sh - Runs the traces through every allocator of this directory
+# (the mdriver-<name> drivers built by "make variants") and prints their
+# utilization and throughput side by side, one trace per line.
+#
+# Each trace runs in a driver of its own with a timeout, so a variant
+# which crashes or is too slow on a trace only loses that trace.
+#
+# usage: ./shootout.sh [-s <secs>] [-t <dir>] [trace ...]
+#        default: the traces of config.h in traces/, 120 secs per trace
+#
+
+secs=120
+dir=traces
+
+usage() {
+    echo "usage: $0 [-h] [-s <secs>] [-t <dir>] [trace ...]"
+    echo "  -s <secs>  timeout of each trace (default 120)"
+    echo "  -t <dir>   directory of the traces (default traces)"
+}
+
+while getopts "s:t:h" c; do
+    case $c in
+    s) secs=$OPTARG ;;
+    t) dir=$OPTARG ;;
+    h) usage; exit 0 ;;
+    *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -gt 0 ]; then
+    traces=("$@")
+else
+    traces=($(sed -n '/DEFAULT_TRACEFILES/,/^$/p' config.h |
+              grep -o '"[^"]*"' | tr -d '"'))
+fi
+
+variants=()
+for d in mdriver-*; do
+    [ -x "$d" ] && variants+=("${d#mdriver-}")
+done
+if [ ${#variants[@]} -eq 0 ]; then
+    echo "$0: no mdriver-<name> driver, run \"make variants\" first"
+    exit 1
+fi
+
+# calc - prints the value of an arithmetic expression
+calc() {
+    awk "BEGIN { print $1 }"
+}
+
+declare -A util kops
+declare -A sumops sumsecs sumutil valid
+
+for v in "${variants[@]}"; do
+    echo "Running mdriver-$v" >&2
+    for t in "${traces[@]}"; do
+        out=$(timeout $((secs + 10)) ./mdriver-$v -s $secs -f "$dir/$t" 2>&1)
+        status=$?
+        # valid util ops secs Kops of the trace line (after the weight)
+        set -- $(echo "$out" | awk -v t="$dir/$t" '$NF == "./" t {
+                     for (i = 1; i < NF; i++)
+                         if ($i == "yes" || $i == "no") break
+                     print $i, $(i+1), $(i+2), $(i+3), $(i+4) }')
+        if [ "$1" = yes ]; then
+            util[$v,$t]=$2
+            kops[$v,$t]=$5
+            sumops[$v]=$(calc "${sumops[$v]:-0} + $3")
+            sumsecs[$v]=$(calc "${sumsecs[$v]:-0} + $4")
+            sumutil[$v]=$(calc "${sumutil[$v]:-0} + ${2%\%}")
+            valid[$v]=$((${valid[$v]:-0} + 1))
+        elif [ "$status" -eq 124 ] || [[ $out == *"timed out"* ]]; then
+            util[$v,$t]=timeout
+            kops[$v,$t]=-
+        elif [ "$1" = no ]; then
+            util[$v,$t]=invalid
+            kops[$v,$t]=-
+        else
+            util[$v,$t]=crash
+            kops[$v,$t]=-
+        fi
+    done
+done
+
+# table - prints one table of the results in $1 (util or kops)
+table() {
+    local -n res=$1
+    local v t
+
+    printf "\n%-22s" "$2"
+    for v in "${variants[@]}"; do
+        printf " %*s" $((${#v} > 8 ? ${#v} : 8)) "$v"
+    done
+    printf "\n"
+    for t in "${traces[@]}"; do
+        printf "%-22s" "$t"
+        for v in "${variants[@]}"; do
+            printf " %*s" $((${#v} > 8 ? ${#v} : 8)) "${res[$v,$t]}"
+        done
+        printf "\n"
+    done
+}
+
+table util "utilization"
+printf "%-22s" "average (valid)"
+for v in "${variants[@]}"; do
+    w=$((${#v} > 8 ? ${#v} : 8))
+    if [ "${valid[$v]:-0}" -gt 0 ]; then
+        printf " %*.0f%%" $((w - 1)) \
+               "$(calc "${sumutil[$v]} / ${valid[$v]}")"
+    else
+        printf " %*s" $w -
+    fi
+done
+printf "\n"
+
+table kops "Kops"
+printf "%-22s" "overall (valid)"
+for v in "${variants[@]}"; do
+    w=$((${#v} > 8 ? ${#v} : 8))
+    if [ "${valid[$v]:-0}" -gt 0 ]; then
+        printf " %*.0f" $w \
+               "$(calc "${sumops[$v]} / ${sumsecs[$v]} / 1000")"
+    else
+        printf " %*s" $w -
+    fi
+done
+printf "\n%-22s" "valid traces"
+for v in "${variants[@]}"; do
+    printf " %*s" $((${#v} > 8 ? ${#v} : 8)) \
+           "${valid[$v]:-0}/${#traces[@]}"
+done
+printf "\n"